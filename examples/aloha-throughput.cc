@@ -18,6 +18,7 @@
 #include "ns3/position-allocator.h"
 #include "ns3/double.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/rng-seed-manager.h"
 #include "ns3/periodic-sender-helper.h"
 #include "ns3/command-line.h"
 #include "ns3/network-server-helper.h"
@@ -28,68 +29,76 @@
 #include "ns3/forwarder-helper.h"
 #include <algorithm>
 #include <ctime>
+#include <map>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace ns3;
 using namespace lorawan;
 
 NS_LOG_COMPONENT_DEFINE ("AlohaThroughput");
 
-// Network settings
-int nDevices = 200;
-int nGateways = 1;
-double radius = 1000;
-double simulationTime = 100;
-
-// Channel model
-bool realisticChannelModel = false;
-
-std::vector<int> packetsSent (6, 0);
-std::vector<int> packetsReceived (6, 0);
+/**
+ * The parameters of a single simulation.
+ */
+struct AlohaParameters
+{
+  int nDevices = 200;
+  int nGateways = 1;
+  double radius = 1000;
+  double simulationTime = 100;
+  std::string interferenceMatrix = "aloha";
+  uint64_t run = 1;
+  bool realisticChannelModel = false;
+};
+
+/**
+ * The outcome of a single simulation, per spreading factor.
+ */
+struct AlohaResults
+{
+  std::vector<int> packetsSent = std::vector<int> (6, 0);
+  std::vector<int> packetsReceived = std::vector<int> (6, 0);
+  std::vector<int64_t> onAirTimeUs = std::vector<int64_t> (6, 0);
+};
 
 void
-OnTransmissionCallback (Ptr<Packet const> packet, uint32_t systemId)
+OnTransmissionCallback (AlohaResults *results, Ptr<Packet const> packet, uint32_t systemId)
 {
   NS_LOG_FUNCTION (packet << systemId);
   LoraTag tag;
   packet->PeekPacketTag(tag);
-  packetsSent.at(tag.GetSpreadingFactor()-7)++;
+  results->packetsSent.at(tag.GetSpreadingFactor()-7)++;
 }
 
 void
-OnPacketReceptionCallback (Ptr<Packet const> packet, uint32_t systemId)
+OnPacketReceptionCallback (AlohaResults *results, Ptr<Packet const> packet, uint32_t systemId)
 {
   NS_LOG_FUNCTION (packet << systemId);
   LoraTag tag;
   packet->PeekPacketTag(tag);
-  packetsReceived.at(tag.GetSpreadingFactor()-7)++;
+  results->packetsReceived.at(tag.GetSpreadingFactor()-7)++;
 }
 
-int
-main (int argc, char *argv[])
+/**
+ * Run a simulation and collect its results.
+ */
+AlohaResults
+RunSimulation (const AlohaParameters &params)
 {
+  AlohaResults results;
 
-  std::string interferenceMatrix = "aloha";
-
-  CommandLine cmd;
-  cmd.AddValue ("nDevices", "Number of end devices to include in the simulation", nDevices);
-  cmd.AddValue ("simulationTime", "Simulation Time", simulationTime);
-  cmd.AddValue ("interferenceMatrix", "Interference matrix to use [aloha, goursaud]", interferenceMatrix);
-  cmd.AddValue ("radius", "Radius of the deployment", radius);
-  cmd.Parse (argc, argv);
-
-  int appPeriodSeconds = simulationTime;
-
-  // Set up logging
-  LogComponentEnable ("AlohaThroughput", LOG_LEVEL_ALL);
+  int appPeriodSeconds = params.simulationTime;
 
   // Make all devices use SF7 (i.e., DR5)
   // Config::SetDefault ("ns3::EndDeviceLorawanMac::DataRate", UintegerValue (5));
 
-  if (interferenceMatrix == "aloha")
+  if (params.interferenceMatrix == "aloha")
   {
     LoraInterferenceHelper::collisionMatrix = LoraInterferenceHelper::ALOHA;
   }
-  else if (interferenceMatrix == "goursaud")
+  else if (params.interferenceMatrix == "goursaud")
   {
     LoraInterferenceHelper::collisionMatrix = LoraInterferenceHelper::GOURSAUD;
   }
@@ -100,7 +109,7 @@ main (int argc, char *argv[])
 
   // Mobility
   MobilityHelper mobility;
-  mobility.SetPositionAllocator ("ns3::UniformDiscPositionAllocator", "rho", DoubleValue (radius),
+  mobility.SetPositionAllocator ("ns3::UniformDiscPositionAllocator", "rho", DoubleValue (params.radius),
                                  "X", DoubleValue (0.0), "Y", DoubleValue (0.0));
   mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
 
@@ -113,7 +122,7 @@ main (int argc, char *argv[])
   loss->SetPathLossExponent (3.76);
   loss->SetReference (1, 7.7);
 
-  if (realisticChannelModel)
+  if (params.realisticChannelModel)
     {
       // Create the correlated shadowing component
       Ptr<CorrelatedShadowingPropagationLossModel> shadowing =
@@ -160,7 +169,7 @@ main (int argc, char *argv[])
 
   // Create a set of nodes
   NodeContainer endDevices;
-  endDevices.Create (nDevices);
+  endDevices.Create (params.nDevices);
 
   // Assign a mobility model to each node
   mobility.Install (endDevices);
@@ -188,21 +197,13 @@ main (int argc, char *argv[])
 
   // Now end devices are connected to the channel
 
-  // Connect trace sources
-  for (NodeContainer::Iterator j = endDevices.Begin (); j != endDevices.End (); ++j)
-    {
-      Ptr<Node> node = *j;
-      Ptr<LoraNetDevice> loraNetDevice = node->GetDevice (0)->GetObject<LoraNetDevice> ();
-      Ptr<LoraPhy> phy = loraNetDevice->GetPhy ();
-    }
-
   /*********************
    *  Create Gateways  *
    *********************/
 
   // Create the gateway nodes (allocate them uniformely on the disc)
   NodeContainer gateways;
-  gateways.Create (nGateways);
+  gateways.Create (params.nGateways);
 
   Ptr<ListPositionAllocator> allocator = CreateObject<ListPositionAllocator> ();
   // Make it so that nodes are at a certain height > 0
@@ -221,7 +222,7 @@ main (int argc, char *argv[])
    *  Install applications on the end devices  *
    *********************************************/
 
-  Time appStopTime = Seconds (simulationTime);
+  Time appStopTime = Seconds (params.simulationTime);
   int packetSize = 50;
   PeriodicSenderHelper appHelper = PeriodicSenderHelper ();
   appHelper.SetPeriod (Seconds (appPeriodSeconds));
@@ -231,10 +232,6 @@ main (int argc, char *argv[])
   appContainer.Start (Seconds (0));
   appContainer.Stop (appStopTime);
 
-
-  std::ofstream outputFile;
-  // Delete contents of the file as it is opened
-  outputFile.open ("durations.txt", std::ofstream::out | std::ofstream::trunc);
   for (uint8_t sf = 7; sf <= 12; sf++)
     {
       LoraTxParameters txParams;
@@ -262,9 +259,8 @@ main (int argc, char *argv[])
       macHdr.SetMajor (1);
       pkt->AddHeader (macHdr);
 
-      outputFile << LoraPhy::GetOnAirTime (pkt, txParams).GetMicroSeconds() << " ";
+      results.onAirTimeUs.at (sf - 7) = LoraPhy::GetOnAirTime (pkt, txParams).GetMicroSeconds ();
     }
-  outputFile.close ();
 
   /**************************
    *  Create Network Server  *
@@ -286,14 +282,14 @@ main (int argc, char *argv[])
   for (NodeContainer::Iterator node = gateways.Begin (); node != gateways.End(); node++)
   {
     (*node)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ()->TraceConnectWithoutContext (
-        "ReceivedPacket", MakeCallback (OnPacketReceptionCallback));
+        "ReceivedPacket", MakeBoundCallback (OnPacketReceptionCallback, &results));
   }
 
   // Install trace sources
   for (NodeContainer::Iterator node = endDevices.Begin (); node != endDevices.End(); node++)
   {
     (*node)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ()->TraceConnectWithoutContext (
-        "StartSending", MakeCallback (OnTransmissionCallback));
+        "StartSending", MakeBoundCallback (OnTransmissionCallback, &results));
   }
 
   macHelper.SetSpreadingFactorsUp (endDevices, gateways, channel);
@@ -309,6 +305,237 @@ main (int argc, char *argv[])
 
   Simulator::Destroy ();
 
+  return results;
+}
+
+/**
+ * Split a comma-separated list of values.
+ */
+template <typename T>
+std::vector<T>
+ParseList (std::string list)
+{
+  std::vector<T> values;
+  std::replace (list.begin (), list.end (), ',', ' ');
+  std::istringstream stream (list);
+  T value;
+  while (stream >> value)
+    {
+      values.push_back (value);
+    }
+  return values;
+}
+
+/**
+ * Format the results of a simulation as rows of the sweep's output file, one
+ * for each spreading factor.
+ */
+std::string
+FormatRows (const AlohaParameters &params, const AlohaResults &results)
+{
+  std::ostringstream rows;
+  for (int i = 0; i < 6; i++)
+    {
+      rows << params.nDevices << "," << params.simulationTime << "," <<
+        params.radius << "," << params.interferenceMatrix << "," <<
+        params.run << "," << i + 7 << "," << results.packetsSent.at (i) <<
+        "," << results.packetsReceived.at (i) << "," <<
+        results.onAirTimeUs.at (i) << "\n";
+    }
+  return rows.str ();
+}
+
+/**
+ * Run a grid of simulations, each in its own process, keeping up to a given
+ * number of them running at the same time.
+ *
+ * The simulator is a process-wide singleton, so simulations cannot share an
+ * address space. Processes are forked from this one, after the command line
+ * was parsed, and report their rows through a pipe as soon as they finish.
+ * Rows are written to the output file in order of completion.
+ *
+ * All simulations use the global seed, and each one sets its own run number,
+ * so that they are independent replications.
+ */
+int
+RunSweep (const std::vector<AlohaParameters> &points, unsigned jobs,
+          std::string outputFileName)
+{
+  std::ofstream outputFile;
+  outputFile.open (outputFileName.c_str (), std::ofstream::out | std::ofstream::trunc);
+  outputFile << "nDevices,simulationTime,radius,interferenceMatrix,run,sf,"
+             << "sent,received,onAirTimeUs" << std::endl;
+
+  std::map<pid_t, int> running; // Pid of each worker, and the end of its pipe
+  unsigned next = 0;
+  unsigned failed = 0;
+  while (next < points.size () || !running.empty ())
+    {
+      // Keep all workers busy
+      while (next < points.size () && running.size () < jobs)
+        {
+          int fds[2];
+          if (pipe (fds) != 0)
+            {
+              NS_FATAL_ERROR ("Unable to create a pipe for a worker");
+            }
+          pid_t pid = fork ();
+          if (pid < 0)
+            {
+              NS_FATAL_ERROR ("Unable to start a worker");
+            }
+          if (pid == 0)
+            {
+              close (fds[0]);
+              RngSeedManager::SetRun (points[next].run);
+              std::string rows = FormatRows (points[next], RunSimulation (points[next]));
+              size_t written = 0;
+              while (written < rows.size ())
+                {
+                  ssize_t n = write (fds[1], rows.data () + written, rows.size () - written);
+                  if (n <= 0)
+                    {
+                      _exit (1);
+                    }
+                  written += n;
+                }
+              close (fds[1]);
+              _exit (0);
+            }
+          close (fds[1]);
+          running[pid] = fds[0];
+          next++;
+        }
+
+      // Collect the output of a worker that finished. Rows are read after the
+      // worker exits, so they must fit in the pipe's buffer, which holds
+      // several kilobytes: six short rows always do.
+      int status;
+      pid_t pid = waitpid (-1, &status, 0);
+      std::map<pid_t, int>::iterator it = running.find (pid);
+      if (it == running.end ())
+        {
+          continue;
+        }
+      char buffer[512];
+      ssize_t n;
+      while ((n = read (it->second, buffer, sizeof (buffer))) > 0)
+        {
+          outputFile.write (buffer, n);
+        }
+      outputFile.flush ();
+      close (it->second);
+      running.erase (it);
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          failed++;
+        }
+    }
+
+  outputFile.close ();
+
+  if (failed > 0)
+    {
+      std::cerr << failed << " simulations failed" << std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AlohaParameters params;
+
+  // Parameter grid for sweeps
+  std::string sweepDevices = "";
+  std::string sweepRadii = "";
+  std::string sweepMatrices = "";
+  std::string sweepRuns = "";
+  std::string sweepTimes = "";
+  unsigned jobs = std::max (1L, sysconf (_SC_NPROCESSORS_ONLN));
+  std::string outputFileName = "aloha-sweep.csv";
+
+  CommandLine cmd;
+  cmd.AddValue ("nDevices", "Number of end devices to include in the simulation", params.nDevices);
+  cmd.AddValue ("simulationTime", "Simulation Time", params.simulationTime);
+  cmd.AddValue ("interferenceMatrix", "Interference matrix to use [aloha, goursaud]", params.interferenceMatrix);
+  cmd.AddValue ("radius", "Radius of the deployment", params.radius);
+  cmd.AddValue ("sweepDevices", "Comma-separated numbers of end devices to sweep over", sweepDevices);
+  cmd.AddValue ("sweepRadii", "Comma-separated deployment radii to sweep over", sweepRadii);
+  cmd.AddValue ("sweepMatrices", "Comma-separated interference matrices to sweep over", sweepMatrices);
+  cmd.AddValue ("sweepRuns", "Comma-separated run numbers to sweep over, with the seed given by RngSeed", sweepRuns);
+  cmd.AddValue ("sweepTimes", "Comma-separated simulation times to sweep over", sweepTimes);
+  cmd.AddValue ("jobs", "Number of simulations of a sweep to run at the same time", jobs);
+  cmd.AddValue ("output", "File where the results of a sweep are written", outputFileName);
+  cmd.Parse (argc, argv);
+
+  // Single runs keep the run number given by RngRun
+  params.run = RngSeedManager::GetRun ();
+
+  if (sweepDevices != "" || sweepRadii != "" || sweepMatrices != "" ||
+      sweepRuns != "" || sweepTimes != "")
+    {
+      // Parameters that are not swept keep their single-run value
+      std::vector<int> devices = ParseList<int> (sweepDevices);
+      std::vector<double> radii = ParseList<double> (sweepRadii);
+      std::vector<std::string> matrices = ParseList<std::string> (sweepMatrices);
+      std::vector<uint64_t> runs = ParseList<uint64_t> (sweepRuns);
+      std::vector<double> times = ParseList<double> (sweepTimes);
+      if (devices.empty ())
+        {
+          devices.push_back (params.nDevices);
+        }
+      if (radii.empty ())
+        {
+          radii.push_back (params.radius);
+        }
+      if (matrices.empty ())
+        {
+          matrices.push_back (params.interferenceMatrix);
+        }
+      if (runs.empty ())
+        {
+          runs.push_back (params.run);
+        }
+      if (times.empty ())
+        {
+          times.push_back (params.simulationTime);
+        }
+
+      std::vector<AlohaParameters> points;
+      for (auto d : devices)
+        for (auto r : radii)
+          for (auto m : matrices)
+            for (auto t : times)
+              for (auto n : runs)
+                {
+                  AlohaParameters point = params;
+                  point.nDevices = d;
+                  point.radius = r;
+                  point.interferenceMatrix = m;
+                  point.simulationTime = t;
+                  point.run = n;
+                  points.push_back (point);
+                }
+
+      return RunSweep (points, std::max (1u, jobs), outputFileName);
+    }
+
+  // Set up logging
+  LogComponentEnable ("AlohaThroughput", LOG_LEVEL_ALL);
+
+  AlohaResults results = RunSimulation (params);
+
+  std::ofstream outputFile;
+  // Delete contents of the file as it is opened
+  outputFile.open ("durations.txt", std::ofstream::out | std::ofstream::trunc);
+  for (int i = 0; i < 6; i++)
+    {
+      outputFile << results.onAirTimeUs.at (i) << " ";
+    }
+  outputFile.close ();
+
   /////////////////////////////
   // Print results to stdout //
   /////////////////////////////
@@ -316,7 +543,7 @@ main (int argc, char *argv[])
 
   for (int i = 0; i < 6; i++)
   {
-    std::cout << packetsSent.at(i) << " " << packetsReceived.at(i) << std::endl;
+    std::cout << results.packetsSent.at(i) << " " << results.packetsReceived.at(i) << std::endl;
   }
 
   return 0;
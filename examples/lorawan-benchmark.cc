@@ -0,0 +1,431 @@
+/*
+ * This script times the hot paths of the PHY layer and of the channel for
+ * networks of different sizes, to catch performance regressions.
+ *
+ * Each benchmark runs in its own process, and prints a line containing a JSON
+ * object with the number of operations it performed, the wall clock time it
+ * took, the resulting operations per second, the wall clock time per
+ * simulated hour (for the benchmarks that advance the simulation clock) and
+ * the peak resident set size of the process.
+ */
+
+#include "ns3/lora-interference-helper.h"
+#include "ns3/lora-packet-tracker.h"
+#include "ns3/lora-phy.h"
+#include "ns3/lora-frame-header.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include "ns3/lora-helper.h"
+#include "ns3/node-container.h"
+#include "ns3/mobility-helper.h"
+#include "ns3/position-allocator.h"
+#include "ns3/double.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/periodic-sender-helper.h"
+#include "ns3/command-line.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ns3;
+using namespace lorawan;
+
+NS_LOG_COMPONENT_DEFINE ("LorawanBenchmark");
+
+/**
+ * What a benchmark measured.
+ */
+struct BenchmarkResult
+{
+  uint64_t operations = 0;  //!< The number of timed operations
+  double wallSeconds = 0;  //!< The wall clock time it took
+  double simulatedSeconds = 0;  //!< The simulated time it covered, if any
+};
+
+/**
+ * Create an uplink packet, with its headers.
+ */
+Ptr<Packet>
+CreateUplink (uint32_t payloadSize)
+{
+  Ptr<Packet> packet = Create<Packet> (payloadSize);
+
+  LoraFrameHeader frameHdr;
+  frameHdr.SetAsUplink ();
+  frameHdr.SetFPort (1);
+  frameHdr.SetAddress (LoraDeviceAddress ());
+  frameHdr.SetFCnt (0);
+  packet->AddHeader (frameHdr);
+
+  LorawanMacHeader macHdr;
+  macHdr.SetMType (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+  macHdr.SetMajor (1);
+  packet->AddHeader (macHdr);
+
+  return packet;
+}
+
+/**
+ * Get the transmission parameters used for a spreading factor.
+ */
+LoraTxParameters
+GetTxParameters (uint8_t sf)
+{
+  LoraTxParameters txParams;
+  txParams.sf = sf;
+  txParams.headerDisabled = 0;
+  txParams.codingRate = 1;
+  txParams.bandwidthHz = 125000;
+  txParams.nPreamble = 8;
+  txParams.crcEnabled = 1;
+  txParams.lowDataRateOptimizationEnabled =
+    LoraPhy::GetTSym (txParams) > MilliSeconds (16) ? true : false;
+  return txParams;
+}
+
+//////////////////////////////////////
+// LoraInterferenceHelper benchmark //
+//////////////////////////////////////
+
+void
+CheckInterference (LoraInterferenceHelper *helper,
+                   Ptr<LoraInterferenceHelper::Event> event,
+                   uint64_t *operations)
+{
+  helper->IsDestroyedByInterference (event);
+  (*operations)++;
+}
+
+void
+AddInterferenceEvent (LoraInterferenceHelper *helper, Time duration,
+                      double rxPowerDbm, uint8_t sf, Ptr<Packet> packet,
+                      double frequencyMHz, uint64_t *operations)
+{
+  Ptr<LoraInterferenceHelper::Event> event =
+    helper->Add (duration, rxPowerDbm, sf, packet, frequencyMHz);
+  Simulator::Schedule (duration, &CheckInterference, helper, event, operations);
+}
+
+/**
+ * Every device sends a packet per hour, and the outcome of each packet is
+ * checked when its reception ends.
+ */
+BenchmarkResult
+BenchmarkInterference (uint32_t nDevices)
+{
+  BenchmarkResult result;
+  result.simulatedSeconds = 3600;
+
+  Ptr<UniformRandomVariable> rng = CreateObject<UniformRandomVariable> ();
+  double frequencies[] = {868.1, 868.3, 868.5};
+  Ptr<Packet> packet = CreateUplink (20);
+
+  LoraInterferenceHelper helper;
+  for (uint32_t i = 0; i < nDevices; i++)
+    {
+      uint8_t sf = rng->GetInteger (7, 12);
+      Simulator::Schedule (Seconds (rng->GetValue (0, result.simulatedSeconds)),
+                           &AddInterferenceEvent, &helper,
+                           LoraPhy::GetOnAirTime (packet, GetTxParameters (sf)),
+                           rng->GetValue (-130, -90), sf, packet,
+                           frequencies[rng->GetInteger (0, 2)],
+                           &result.operations);
+    }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  Simulator::Run ();
+  result.wallSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  Simulator::Destroy ();
+
+  return result;
+}
+
+///////////////////////////
+// LoraChannel benchmark //
+///////////////////////////
+
+/**
+ * A full PHY and MAC stack, where every device sends a packet per hour to a
+ * gateway: each transmission is fanned out by the channel to all the PHYs
+ * connected to it.
+ */
+BenchmarkResult
+BenchmarkSend (uint32_t nDevices)
+{
+  BenchmarkResult result;
+  result.simulatedSeconds = 3600;
+
+  Ptr<LogDistancePropagationLossModel> loss = CreateObject<LogDistancePropagationLossModel> ();
+  loss->SetPathLossExponent (3.76);
+  loss->SetReference (1, 7.7);
+  Ptr<PropagationDelayModel> delay = CreateObject<ConstantSpeedPropagationDelayModel> ();
+  Ptr<LoraChannel> channel = CreateObject<LoraChannel> (loss, delay);
+
+  LoraPhyHelper phyHelper = LoraPhyHelper ();
+  phyHelper.SetChannel (channel);
+  LorawanMacHelper macHelper = LorawanMacHelper ();
+  LoraHelper helper = LoraHelper ();
+
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator ("ns3::UniformDiscPositionAllocator", "rho", DoubleValue (5000),
+                                 "X", DoubleValue (0.0), "Y", DoubleValue (0.0));
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+
+  NodeContainer endDevices;
+  endDevices.Create (nDevices);
+  mobility.Install (endDevices);
+  phyHelper.SetDeviceType (LoraPhyHelper::ED);
+  macHelper.SetDeviceType (LorawanMacHelper::ED_A);
+  macHelper.SetAddressGenerator (CreateObject<LoraDeviceAddressGenerator> (54, 1864));
+  helper.Install (phyHelper, macHelper, endDevices);
+
+  NodeContainer gateways;
+  gateways.Create (1);
+  Ptr<ListPositionAllocator> allocator = CreateObject<ListPositionAllocator> ();
+  allocator->Add (Vector (0.0, 0.0, 15.0));
+  mobility.SetPositionAllocator (allocator);
+  mobility.Install (gateways);
+  phyHelper.SetDeviceType (LoraPhyHelper::GW);
+  macHelper.SetDeviceType (LorawanMacHelper::GW);
+  helper.Install (phyHelper, macHelper, gateways);
+
+  macHelper.SetSpreadingFactorsUp (endDevices, gateways, channel);
+
+  PeriodicSenderHelper appHelper = PeriodicSenderHelper ();
+  appHelper.SetPeriod (Seconds (result.simulatedSeconds));
+  ApplicationContainer appContainer = appHelper.Install (endDevices);
+  appContainer.Start (Seconds (0));
+  appContainer.Stop (Seconds (result.simulatedSeconds));
+
+  Simulator::Stop (Seconds (result.simulatedSeconds));
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  Simulator::Run ();
+  result.wallSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  // Here, an operation is a simulator event
+  result.operations = Simulator::GetEventCount ();
+
+  Simulator::Destroy ();
+
+  return result;
+}
+
+////////////////////////////
+// GetOnAirTime benchmark //
+////////////////////////////
+
+/**
+ * Compute the time on air of a packet of each device, at each spreading
+ * factor.
+ */
+BenchmarkResult
+BenchmarkOnAirTime (uint32_t nDevices)
+{
+  BenchmarkResult result;
+
+  std::vector<Ptr<Packet> > packets;
+  for (uint32_t i = 0; i < nDevices; i++)
+    {
+      packets.push_back (CreateUplink (10 + i % 40));
+    }
+
+  int64_t total = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  for (uint8_t sf = 7; sf <= 12; sf++)
+    {
+      LoraTxParameters txParams = GetTxParameters (sf);
+      for (uint32_t i = 0; i < nDevices; i++)
+        {
+          total += LoraPhy::GetOnAirTime (packets[i], txParams).GetNanoSeconds ();
+          result.operations++;
+        }
+    }
+  result.wallSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  // Use the results, so that the computation cannot be optimized away
+  NS_ABORT_MSG_IF (total <= 0, "Invalid time on air");
+
+  return result;
+}
+
+/////////////////////////////////
+// LoraPacketTracker benchmark //
+/////////////////////////////////
+
+void
+ReceiveAtGateway (LoraPacketTracker *tracker, Ptr<Packet const> packet,
+                  uint32_t gwId, uint64_t *operations)
+{
+  tracker->PacketReceptionCallback (packet, gwId);
+  tracker->MacGwReceptionCallback (packet);
+  (*operations) += 2;
+}
+
+void
+SendFromDevice (LoraPacketTracker *tracker, Ptr<Packet const> packet,
+                uint32_t edId, uint32_t gwId, uint64_t *operations)
+{
+  tracker->MacTransmissionCallback (packet);
+  tracker->TransmissionCallback (packet, edId);
+  (*operations) += 2;
+  Simulator::Schedule (Seconds (1), &ReceiveAtGateway, tracker, packet, gwId, operations);
+}
+
+void
+PrintPerformance (LoraPacketTracker *tracker, uint32_t gwId, Time last,
+                  uint64_t *operations)
+{
+  tracker->CountPhyPacketsPerGw (last, Simulator::Now (), gwId);
+  tracker->CountMacPacketsGlobally (last, Simulator::Now ());
+  (*operations) += 2;
+  Simulator::Schedule (Minutes (1), &PrintPerformance, tracker, gwId,
+                       Simulator::Now (), operations);
+}
+
+/**
+ * Every device sends a packet per hour, which is received by a gateway, while
+ * the performance of the gateway is computed every minute.
+ */
+BenchmarkResult
+BenchmarkTracker (uint32_t nDevices)
+{
+  BenchmarkResult result;
+  result.simulatedSeconds = 3600;
+
+  Ptr<UniformRandomVariable> rng = CreateObject<UniformRandomVariable> ();
+  uint32_t gwId = nDevices;
+
+  LoraPacketTracker tracker;
+  for (uint32_t i = 0; i < nDevices; i++)
+    {
+      Simulator::Schedule (Seconds (rng->GetValue (0, result.simulatedSeconds)),
+                           &SendFromDevice, &tracker,
+                           Ptr<Packet const> (CreateUplink (20)), i, gwId,
+                           &result.operations);
+    }
+  Simulator::Schedule (Minutes (1), &PrintPerformance, &tracker, gwId,
+                       Seconds (0), &result.operations);
+  Simulator::Stop (Seconds (result.simulatedSeconds));
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  Simulator::Run ();
+  result.wallSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  Simulator::Destroy ();
+
+  return result;
+}
+
+////////////
+// Runner //
+////////////
+
+/**
+ * Run a benchmark and format its result as a JSON object.
+ */
+std::string
+RunBenchmark (std::string name, uint32_t nDevices)
+{
+  BenchmarkResult result;
+  if (name == "interference")
+    {
+      result = BenchmarkInterference (nDevices);
+    }
+  else if (name == "send")
+    {
+      result = BenchmarkSend (nDevices);
+    }
+  else if (name == "on-air-time")
+    {
+      result = BenchmarkOnAirTime (nDevices);
+    }
+  else if (name == "tracker")
+    {
+      result = BenchmarkTracker (nDevices);
+    }
+  else
+    {
+      NS_FATAL_ERROR ("Unknown benchmark " << name);
+    }
+
+  // On Linux, ru_maxrss is in kilobytes
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+
+  std::ostringstream json;
+  json << "{\"benchmark\": \"" << name << "\", \"devices\": " << nDevices <<
+    ", \"operations\": " << result.operations <<
+    ", \"wallSeconds\": " << result.wallSeconds <<
+    ", \"operationsPerSecond\": " <<
+    (result.wallSeconds > 0 ? result.operations / result.wallSeconds : 0) <<
+    ", \"wallSecondsPerSimulatedHour\": ";
+  if (result.simulatedSeconds > 0)
+    {
+      json << result.wallSeconds * 3600 / result.simulatedSeconds;
+    }
+  else
+    {
+      json << "null";
+    }
+  json << ", \"peakRssKb\": " << usage.ru_maxrss << "}";
+  return json.str ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string devices = "1000,10000,100000";
+  std::string benchmarks = "interference,send,on-air-time,tracker";
+
+  CommandLine cmd;
+  cmd.AddValue ("devices", "Comma-separated network sizes to benchmark", devices);
+  cmd.AddValue ("benchmarks",
+                "Comma-separated benchmarks to run [interference, send, on-air-time, tracker]",
+                benchmarks);
+  cmd.Parse (argc, argv);
+
+  std::replace (devices.begin (), devices.end (), ',', ' ');
+  std::replace (benchmarks.begin (), benchmarks.end (), ',', ' ');
+
+  int failed = 0;
+  std::istringstream benchmarkStream (benchmarks);
+  std::string name;
+  while (benchmarkStream >> name)
+    {
+      std::istringstream deviceStream (devices);
+      uint32_t nDevices;
+      while (deviceStream >> nDevices)
+        {
+          // Run each benchmark in a child process, so that its peak memory
+          // usage is not affected by the ones that ran before it
+          std::cout.flush ();
+          pid_t pid = fork ();
+          if (pid < 0)
+            {
+              NS_FATAL_ERROR ("Unable to start a benchmark");
+            }
+          if (pid == 0)
+            {
+              std::cout << RunBenchmark (name, nDevices) << std::endl;
+              _exit (0);
+            }
+          int status;
+          waitpid (pid, &status, 0);
+          if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+            {
+              std::cerr << "Benchmark " << name << " failed with " << nDevices <<
+                " devices" << std::endl;
+              failed++;
+            }
+        }
+    }
+
+  return failed > 0 ? 1 : 0;
+}
@@ -22,6 +22,7 @@
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include "ns3/lorawan-mac-header.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -30,6 +31,8 @@ namespace lorawan {
 NS_LOG_COMPONENT_DEFINE ("LoraPacketTracker");
 
 LoraPacketTracker::LoraPacketTracker ()
+  : m_releaseDelay (Seconds (10)),
+  m_bucketWidth (Seconds (60))
 {
   NS_LOG_FUNCTION (this);
 }
@@ -39,6 +42,113 @@ LoraPacketTracker::~LoraPacketTracker ()
   NS_LOG_FUNCTION (this);
 }
 
+void
+LoraPacketTracker::SetReleaseDelay (Time delay)
+{
+  NS_LOG_FUNCTION (this << delay);
+
+  m_releaseDelay = delay;
+}
+
+void
+LoraPacketTracker::SetBucketWidth (Time width)
+{
+  NS_LOG_FUNCTION (this << width);
+
+  NS_ASSERT_MSG (m_phySendTimes.empty () && m_macSendTimes.empty () &&
+                 m_reTxFirstAttempts.empty (),
+                 "The bucket width can only be set before tracking packets");
+  NS_ASSERT (width.IsStrictlyPositive ());
+
+  m_bucketWidth = width;
+}
+
+LoraPacketTracker::PhyBucket::PhyBucket ()
+{
+  std::fill (counts, counts + UNSET, 0);
+}
+
+LoraPacketTracker::RetransmissionBucket::RetransmissionBucket ()
+  : sent (0),
+  successful (0)
+{
+}
+
+uint32_t
+LoraPacketTracker::GetBucket (Time time) const
+{
+  if (time.IsNegative ())
+    {
+      return 0;
+    }
+  return time.GetTimeStep () / m_bucketWidth.GetTimeStep ();
+}
+
+uint32_t
+LoraPacketTracker::GetFirstId (const std::vector<Time> &sendTimes, Time time)
+{
+  return std::lower_bound (sendTimes.begin (), sendTimes.end (), time) -
+         sendTimes.begin ();
+}
+
+uint32_t
+LoraPacketTracker::GetEndId (const std::vector<Time> &sendTimes, Time time)
+{
+  return std::upper_bound (sendTimes.begin (), sendTimes.end (), time) -
+         sendTimes.begin ();
+}
+
+void
+LoraPacketTracker::InFlightPackets::Add (Ptr<Packet const> packet, uint32_t id, bool keep)
+{
+  // If the same packet is sent again, its outcomes refer to the new
+  // transmission from now on
+  Entry &entry = m_entries[PeekPointer (packet)];
+  entry.packet = packet;
+  entry.id = id;
+  entry.keep = keep;
+  m_order.push_back (std::make_pair (PeekPointer (packet), id));
+}
+
+bool
+LoraPacketTracker::InFlightPackets::Find (Ptr<Packet const> packet, uint32_t &id) const
+{
+  std::unordered_map<const Packet *, Entry>::const_iterator it =
+    m_entries.find (PeekPointer (packet));
+  if (it == m_entries.end ())
+    {
+      return false;
+    }
+  id = it->second.id;
+  return true;
+}
+
+void
+LoraPacketTracker::InFlightPackets::Remove (Ptr<Packet const> packet)
+{
+  m_entries.erase (PeekPointer (packet));
+}
+
+void
+LoraPacketTracker::InFlightPackets::Release (const std::vector<Time> &sendTimes,
+                                             Time threshold)
+{
+  // Packets are in send order, so we only need to look at the oldest ones.
+  // An entry is only erased if it still refers to the same transmission:
+  // the packet may have been sent again, or removed and its address reused.
+  while (!m_order.empty () && sendTimes[m_order.front ().second] < threshold)
+    {
+      std::unordered_map<const Packet *, Entry>::iterator it =
+        m_entries.find (m_order.front ().first);
+      if (it != m_entries.end () && it->second.id == m_order.front ().second
+          && !it->second.keep)
+        {
+          m_entries.erase (it);
+        }
+      m_order.pop_front ();
+    }
+}
+
 /////////////////
 // MAC metrics //
 /////////////////
@@ -50,14 +160,21 @@ LoraPacketTracker::MacTransmissionCallback (Ptr<Packet const> packet)
     {
       NS_LOG_INFO ("A new packet was sent by the MAC layer");
 
-      MacPacketStatus status;
-      status.packet = packet;
-      status.sendTime = Simulator::Now ();
-      status.senderId = Simulator::GetContext ();
-      status.receivedTime = Time::Max ();
+      m_macInFlight.Release (m_macSendTimes, Simulator::Now () - m_releaseDelay);
+
+      uint32_t id = m_macSendTimes.size ();
+      m_macSendTimes.push_back (Simulator::Now ());
+      m_macReceptions.push_back (0);
+
+      uint32_t bucket = GetBucket (Simulator::Now ());
+      if (m_macReceivedPerBucket.size () <= bucket)
+        {
+          m_macReceivedPerBucket.resize (bucket + 1, 0);
+        }
 
-      m_macPacketTracker.insert (std::pair<Ptr<Packet const>, MacPacketStatus>
-                                   (packet, status));
+      // Retransmissions of confirmed packets reuse the same packet, and may
+      // happen long after this: keep it until the procedure ends.
+      m_macInFlight.Add (packet, id, LorawanMacHeader::Peek (packet).IsConfirmed ());
     }
 }
 
@@ -71,14 +188,24 @@ LoraPacketTracker::RequiredTransmissionsCallback (uint8_t reqTx, bool success,
                 ", succ: " << success << ", firstAttempt: " <<
                 firstAttempt.GetSeconds ());
 
-  RetransmissionStatus entry;
-  entry.firstAttempt = firstAttempt;
-  entry.finishTime = Simulator::Now ();
-  entry.reTxAttempts = reqTx;
-  entry.successful = success;
+  // The outcome of this packet is final: we don't need to keep the packet
+  m_macInFlight.Remove (packet);
 
-  m_reTransmissionTracker.insert (std::pair<Ptr<Packet>, RetransmissionStatus>
-                                    (packet, entry));
+  m_reTxFirstAttempts.push_back (firstAttempt);
+  m_reTxAttempts.push_back (reqTx);
+  m_reTxSuccessful.push_back (success);
+
+  uint32_t bucket = GetBucket (firstAttempt);
+  if (m_reTxBuckets.size () <= bucket)
+    {
+      m_reTxBuckets.resize (bucket + 1);
+    }
+  m_reTxBuckets[bucket].sent++;
+  if (success)
+    {
+      m_reTxBuckets[bucket].successful++;
+    }
+  m_reTxBuckets[bucket].records.push_back (m_reTxFirstAttempts.size () - 1);
 }
 
 void
@@ -90,17 +217,19 @@ LoraPacketTracker::MacGwReceptionCallback (Ptr<Packet const> packet)
                    " at the MAC layer of gateway " <<
                    Simulator::GetContext ());
 
-      // Find the received packet in the m_macPacketTracker
-      auto it = m_macPacketTracker.find (packet);
-      if (it != m_macPacketTracker.end ())
+      // Find the received packet among the ones that were sent
+      uint32_t id;
+      if (m_macInFlight.Find (packet, id))
         {
-          (*it).second.receptionTimes.insert (std::pair<int, Time>
-                                                (Simulator::GetContext (),
-                                                Simulator::Now ()));
+          // Count the packet the first time a gateway receives it
+          if (m_macReceptions[id]++ == 0)
+            {
+              m_macReceivedPerBucket[GetBucket (m_macSendTimes[id])]++;
+            }
         }
       else
         {
-          NS_ABORT_MSG ("Packet not found in tracker");
+          NS_LOG_WARN ("MAC packet " << packet << " was received after being released");
         }
     }
 }
@@ -117,13 +246,37 @@ LoraPacketTracker::TransmissionCallback (Ptr<Packet const> packet, uint32_t edId
       NS_LOG_INFO ("PHY packet " << packet
                                  << " was transmitted by device "
                                  << edId);
-      // Create a packetStatus
-      PacketStatus status;
-      status.packet = packet;
-      status.sendTime = Simulator::Now ();
-      status.senderId = edId;
 
-      m_packetTracker.insert (std::pair<Ptr<Packet const>, PacketStatus> (packet, status));
+      // Outcomes of old packets are final by now
+      m_phyInFlight.Release (m_phySendTimes, Simulator::Now () - m_releaseDelay);
+
+      uint32_t id = m_phySendTimes.size ();
+      m_phySendTimes.push_back (Simulator::Now ());
+
+      m_phyInFlight.Add (packet, id, false);
+    }
+}
+
+void
+LoraPacketTracker::AddPhyOutcome (Ptr<Packet const> packet, uint32_t gwId,
+                                  enum PhyPacketOutcome outcome)
+{
+  uint32_t id;
+  if (m_phyInFlight.Find (packet, id))
+    {
+      std::vector<PhyBucket> &buckets = m_phyOutcomes[gwId];
+      uint32_t bucket = GetBucket (m_phySendTimes[id]);
+      if (buckets.size () <= bucket)
+        {
+          buckets.resize (bucket + 1);
+        }
+      buckets[bucket].counts[outcome]++;
+      buckets[bucket].outcomes.push_back (std::make_pair (id, uint8_t (outcome)));
+    }
+  else
+    {
+      NS_LOG_WARN ("Outcome of PHY packet " << packet << " at gateway " << gwId <<
+                   " was reported after the packet was released");
     }
 }
 
@@ -137,9 +290,7 @@ LoraPacketTracker::PacketReceptionCallback (Ptr<Packet const> packet, uint32_t g
                                  << " was successfully received at gateway "
                                  << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           RECEIVED));
+      AddPhyOutcome (packet, gwId, RECEIVED);
     }
 }
 
@@ -152,9 +303,7 @@ LoraPacketTracker::InterferenceCallback (Ptr<Packet const> packet, uint32_t gwId
                                  << " was interfered at gateway "
                                  << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           INTERFERED));
+      AddPhyOutcome (packet, gwId, INTERFERED);
     }
 }
 
@@ -166,9 +315,8 @@ LoraPacketTracker::NoMoreReceiversCallback (Ptr<Packet const> packet, uint32_t g
       NS_LOG_INFO ("PHY packet " << packet
                                  << " was lost because no more receivers at gateway "
                                  << gwId);
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           NO_MORE_RECEIVERS));
+
+      AddPhyOutcome (packet, gwId, NO_MORE_RECEIVERS);
     }
 }
 
@@ -181,9 +329,7 @@ LoraPacketTracker::UnderSensitivityCallback (Ptr<Packet const> packet, uint32_t
                                  << " was lost because under sensitivity at gateway "
                                  << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           UNDER_SENSITIVITY));
+      AddPhyOutcome (packet, gwId, UNDER_SENSITIVITY);
     }
 }
 
@@ -196,9 +342,7 @@ LoraPacketTracker::LostBecauseTxCallback (Ptr<Packet const> packet, uint32_t gwI
                                  << " was lost because of GW transmission at gateway "
                                  << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           LOST_BECAUSE_TX));
+      AddPhyOutcome (packet, gwId, LOST_BECAUSE_TX);
     }
 }
 
@@ -207,10 +351,7 @@ LoraPacketTracker::IsUplink (Ptr<Packet const> packet)
 {
   NS_LOG_FUNCTION (this);
 
-  LorawanMacHeader mHdr;
-  Ptr<Packet> copy = packet->Copy ();
-  copy->RemoveHeader (mHdr);
-  return mHdr.IsUplink ();
+  return LorawanMacHeader::Peek (packet).IsUplink ();
 }
 
 ////////////////////////
@@ -227,117 +368,59 @@ LoraPacketTracker::CountPhyPacketsPerGw (Time startTime, Time stopTime,
 
   std::vector<int> packetCounts (6, 0);
 
-  for (auto itPhy = m_packetTracker.begin ();
-       itPhy != m_packetTracker.end ();
-       ++itPhy)
+  if (stopTime < startTime)
     {
-      if ((*itPhy).second.sendTime >= startTime && (*itPhy).second.sendTime <= stopTime)
-        {
-          packetCounts.at (0)++;
+      return packetCounts;
+    }
+
+  // Packet ids are assigned in send order: find the ones sent in the interval
+  uint32_t first = GetFirstId (m_phySendTimes, startTime);
+  uint32_t last = GetEndId (m_phySendTimes, stopTime);
+
+  packetCounts.at (0) = last - first;
 
-          NS_LOG_DEBUG ("Dealing with packet " << (*itPhy).second.packet);
-          NS_LOG_DEBUG ("This packet was received by " <<
-                        (*itPhy).second.outcomes.size () << " gateways");
+  std::map<int, std::vector<PhyBucket> >::const_iterator gw =
+    m_phyOutcomes.find (gwId);
+  if (gw == m_phyOutcomes.end ())
+    {
+      return packetCounts;
+    }
 
-          if ((*itPhy).second.outcomes.count (gwId) > 0)
+  const std::vector<PhyBucket> &buckets = gw->second;
+  uint32_t startBucket = GetBucket (startTime);
+  uint32_t stopBucket = GetBucket (stopTime);
+  for (uint32_t b = startBucket; b <= stopBucket && b < buckets.size (); ++b)
+    {
+      if (b != startBucket && b != stopBucket)
+        {
+          // All packets in this bucket were sent in the interval
+          for (int outcome = 0; outcome < UNSET; ++outcome)
             {
-              switch ((*itPhy).second.outcomes.at (gwId))
-                {
-                case RECEIVED:
-                  {
-                    packetCounts.at (1)++;
-                    break;
-                  }
-                case INTERFERED:
-                  {
-                    packetCounts.at (2)++;
-                    break;
-                  }
-                case NO_MORE_RECEIVERS:
-                  {
-                    packetCounts.at (3)++;
-                    break;
-                  }
-                case UNDER_SENSITIVITY:
-                  {
-                    packetCounts.at (4)++;
-                    break;
-                  }
-                case LOST_BECAUSE_TX:
-                  {
-                    packetCounts.at (5)++;
-                    break;
-                  }
-                case UNSET:
-                  {
-                    break;
-                  }
-                }
+              packetCounts.at (1 + outcome) += buckets[b].counts[outcome];
+            }
+          continue;
+        }
+
+      // Buckets at the edges may be partially outside the interval
+      const std::vector<std::pair<uint32_t, uint8_t> > &outcomes = buckets[b].outcomes;
+      for (auto it = outcomes.begin (); it != outcomes.end (); ++it)
+        {
+          if (it->first >= first && it->first < last)
+            {
+              // Outcomes are in the same order of the packetCounts fields
+              packetCounts.at (1 + it->second)++;
             }
         }
     }
 
   return packetCounts;
 }
+
 std::string
 LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
                                          int gwId)
 {
-  // Vector packetCounts will contain - for the interval given in the input of
-  // the function, the following fields: totPacketsSent receivedPackets
-  // interferedPackets noMoreGwPackets underSensitivityPackets lostBecauseTxPackets
-
-  std::vector<int> packetCounts (6, 0);
-
-  for (auto itPhy = m_packetTracker.begin ();
-       itPhy != m_packetTracker.end ();
-       ++itPhy)
-    {
-      if ((*itPhy).second.sendTime >= startTime && (*itPhy).second.sendTime <= stopTime)
-        {
-          packetCounts.at (0)++;
-
-          NS_LOG_DEBUG ("Dealing with packet " << (*itPhy).second.packet);
-          NS_LOG_DEBUG ("This packet was received by " <<
-                        (*itPhy).second.outcomes.size () << " gateways");
-
-          if ((*itPhy).second.outcomes.count (gwId) > 0)
-            {
-              switch ((*itPhy).second.outcomes.at (gwId))
-                {
-                case RECEIVED:
-                  {
-                    packetCounts.at (1)++;
-                    break;
-                  }
-                case INTERFERED:
-                  {
-                    packetCounts.at (2)++;
-                    break;
-                  }
-                case NO_MORE_RECEIVERS:
-                  {
-                    packetCounts.at (3)++;
-                    break;
-                  }
-                case UNDER_SENSITIVITY:
-                  {
-                    packetCounts.at (4)++;
-                    break;
-                  }
-                case LOST_BECAUSE_TX:
-                  {
-                    packetCounts.at (5)++;
-                    break;
-                  }
-                case UNSET:
-                  {
-                    break;
-                  }
-                }
-            }
-        }
-    }
+  std::vector<int> packetCounts = CountPhyPacketsPerGw (startTime, stopTime, gwId);
 
   std::string output ("");
   for (int i = 0; i < 6; ++i)
@@ -353,16 +436,53 @@ LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
   {
     NS_LOG_FUNCTION (this << startTime << stopTime);
 
-    double sent = 0;
+    if (stopTime < startTime)
+      {
+        return std::to_string (0.0) + " " + std::to_string (0.0);
+      }
+
+    uint32_t first = GetFirstId (m_macSendTimes, startTime);
+    uint32_t last = GetEndId (m_macSendTimes, stopTime);
+
+    double sent = last - first;
     double received = 0;
-    for (auto it = m_macPacketTracker.begin ();
-         it != m_macPacketTracker.end ();
-         ++it)
+
+    uint32_t startBucket = GetBucket (startTime);
+    uint32_t stopBucket = GetBucket (stopTime);
+    if (stopBucket - startBucket < 2)
       {
-        if ((*it).second.sendTime >= startTime && (*it).second.sendTime <= stopTime)
+        // No bucket is entirely inside the interval
+        for (uint32_t id = first; id < last; ++id)
           {
-            sent++;
-            if ((*it).second.receptionTimes.size ())
+            if (m_macReceptions[id])
+              {
+                received++;
+              }
+          }
+      }
+    else
+      {
+        // Sum the counters of the inner buckets, and look at the packets that
+        // were sent in the edge ones
+        for (uint32_t b = startBucket + 1;
+             b < stopBucket && b < m_macReceivedPerBucket.size (); ++b)
+          {
+            received += m_macReceivedPerBucket[b];
+          }
+        uint32_t innerFirst = std::max (first, GetFirstId (m_macSendTimes,
+                                                           TimeStep ((startBucket + 1) * m_bucketWidth.GetTimeStep ())));
+        uint32_t innerLast = std::min (last, GetFirstId (m_macSendTimes,
+                                                         TimeStep (stopBucket * m_bucketWidth.GetTimeStep ())));
+        for (uint32_t id = first; id < innerFirst; ++id)
+          {
+            if (m_macReceptions[id])
+              {
+                received++;
+              }
+          }
+        for (uint32_t id = std::max (innerFirst, innerLast); id < last; ++id)
+          {
+            if (m_macReceptions[id])
               {
                 received++;
               }
@@ -380,19 +500,37 @@ LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
 
     double sent = 0;
     double received = 0;
-    for (auto it = m_reTransmissionTracker.begin ();
-         it != m_reTransmissionTracker.end ();
-         ++it)
+
+    if (stopTime < startTime)
       {
-        if ((*it).second.firstAttempt >= startTime && (*it).second.firstAttempt <= stopTime)
+        return std::to_string (sent) + " " + std::to_string (received);
+      }
+
+    uint32_t startBucket = GetBucket (startTime);
+    uint32_t stopBucket = GetBucket (stopTime);
+    for (uint32_t b = startBucket; b <= stopBucket && b < m_reTxBuckets.size (); ++b)
+      {
+        if (b != startBucket && b != stopBucket)
           {
-            sent++;
-            NS_LOG_DEBUG ("Found a packet");
-            NS_LOG_DEBUG ("Number of attempts: " << unsigned(it->second.reTxAttempts) <<
-                          ", successful: " << it->second.successful);
-            if (it->second.successful)
+            sent += m_reTxBuckets[b].sent;
+            received += m_reTxBuckets[b].successful;
+            continue;
+          }
+
+        const std::vector<uint32_t> &records = m_reTxBuckets[b].records;
+        for (auto it = records.begin (); it != records.end (); ++it)
+          {
+            uint32_t i = *it;
+            if (m_reTxFirstAttempts[i] >= startTime && m_reTxFirstAttempts[i] <= stopTime)
               {
-                received++;
+                sent++;
+                NS_LOG_DEBUG ("Found a packet");
+                NS_LOG_DEBUG ("Number of attempts: " << unsigned(m_reTxAttempts[i]) <<
+                              ", successful: " << m_reTxSuccessful[i]);
+                if (m_reTxSuccessful[i])
+                  {
+                    received++;
+                  }
               }
           }
       }
@@ -24,8 +24,11 @@
 #include "ns3/packet.h"
 #include "ns3/nstime.h"
 
+#include <deque>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
@@ -40,42 +43,57 @@ enum PhyPacketOutcome
   UNSET
 };
 
-struct PacketStatus
-{
-  Ptr<Packet const> packet;
-  uint32_t senderId;
-  Time sendTime;
-  std::map<int, enum PhyPacketOutcome> outcomes;
-};
-
-struct MacPacketStatus
-{
-  Ptr<Packet const> packet;
-  uint32_t senderId;
-  Time sendTime;
-  Time receivedTime;
-  std::map<int, Time> receptionTimes;
-};
-
-struct RetransmissionStatus
-{
-  Time firstAttempt;
-  Time finishTime;
-  uint8_t reTxAttempts;
-  bool successful;
-};
-
-typedef std::map<Ptr<Packet const>, MacPacketStatus> MacPacketData;
-typedef std::map<Ptr<Packet const>, PacketStatus> PhyPacketData;
-typedef std::map<Ptr<Packet const>, RetransmissionStatus> RetransmissionData;
-
-
+/**
+ * Keeps track of the packets that go through the network to compute
+ * performance metrics.
+ *
+ * Information about packets is kept in flat arrays indexed by a packet id,
+ * which is assigned in order of transmission. A packet is only referenced by
+ * the tracker while its outcome can still be reported, i.e., for a
+ * configurable delay after its transmission: after that, it is released and
+ * only its compact record is kept. Confirmed MAC packets are kept until their
+ * retransmission procedure ends, since their retransmissions can reach the
+ * gateways long after the first attempt.
+ *
+ * Every transmission of a packet at the PHY layer, including the
+ * retransmissions of confirmed packets, is tracked as a separate PHY packet
+ * with its own outcomes.
+ *
+ * Outcomes are also aggregated as they are reported in counters that cover a
+ * fixed interval of send times. Counting functions sum the counters of the
+ * intervals that are fully included in the requested time frame, and only
+ * look at single packets in the intervals at its edges.
+ */
 class LoraPacketTracker
 {
 public:
   LoraPacketTracker ();
   ~LoraPacketTracker ();
 
+  /**
+   * Set for how long after its transmission a packet can have its outcome
+   * reported.
+   *
+   * After this delay, the tracker releases its reference to the packet,
+   * unless it is a confirmed MAC packet whose retransmission procedure is
+   * still ongoing. Outcomes reported after the packet was released are
+   * logged and ignored.
+   *
+   * \param delay The time after which packets are released.
+   */
+  void SetReleaseDelay (Time delay);
+
+  /**
+   * Set the width of the send time intervals that are used to aggregate
+   * packet outcomes.
+   *
+   * This can only be called before any packet is tracked. Counting functions
+   * are fastest when their time frame is aligned to these intervals.
+   *
+   * \param width The width of the intervals.
+   */
+  void SetBucketWidth (Time width);
+
   /////////////////////////
   // PHY layer callbacks //
   /////////////////////////
@@ -103,10 +121,6 @@ public:
   ///////////////////////////////
   bool IsUplink (Ptr<Packet const> packet);
 
-  // void CountRetransmissions (Time transient, Time simulationTime, MacPacketData
-  //                            macPacketTracker, RetransmissionData reTransmissionTracker,
-  //                            PhyPacketData packetTracker);
-
   /**
    * Count packets to evaluate the performance at PHY level of a specific
    * gateway.
@@ -160,9 +174,138 @@ public:
    */
   std::string CountMacPacketsGloballyCpsr (Time startTime, Time stopTime);
 private:
-  PhyPacketData m_packetTracker;
-  MacPacketData m_macPacketTracker;
-  RetransmissionData m_reTransmissionTracker;
+  /**
+   * Map the packets whose outcome can still be reported to their id.
+   */
+  class InFlightPackets
+  {
+  public:
+    /**
+     * Start tracking a packet.
+     *
+     * \param packet The packet.
+     * \param id The id that was assigned to the packet.
+     * \param keep Whether to keep the packet until it is removed, instead of
+     * releasing it after a delay.
+     */
+    void Add (Ptr<Packet const> packet, uint32_t id, bool keep);
+
+    /**
+     * Get the id of a packet.
+     *
+     * \param packet The packet.
+     * \param id Set to the id of the packet, if it is found.
+     * \return Whether the packet is being tracked.
+     */
+    bool Find (Ptr<Packet const> packet, uint32_t &id) const;
+
+    /**
+     * Stop tracking a packet, whether it was kept or not.
+     *
+     * \param packet The packet.
+     */
+    void Remove (Ptr<Packet const> packet);
+
+    /**
+     * Release the packets that were sent before a certain time, except for
+     * the ones that are kept.
+     *
+     * \param sendTimes The send time of each packet id.
+     * \param threshold The time before which packets are released.
+     */
+    void Release (const std::vector<Time> &sendTimes, Time threshold);
+
+  private:
+    /**
+     * A packet that is being tracked.
+     */
+    struct Entry
+    {
+      Ptr<Packet const> packet;  //!< The packet
+      uint32_t id;  //!< The id of the packet
+      bool keep;  //!< Whether the packet is only released by Remove
+    };
+
+    std::unordered_map<const Packet *, Entry> m_entries;  //!< The tracked packets
+    std::deque<std::pair<const Packet *, uint32_t> > m_order;  //!< Packet ids in send order
+  };
+
+  /**
+   * The outcomes reported by a gateway for the PHY packets sent in an
+   * interval.
+   */
+  struct PhyBucket
+  {
+    PhyBucket ();
+
+    int counts[UNSET];  //!< The number of packets with each outcome
+    std::vector<std::pair<uint32_t, uint8_t> > outcomes;  //!< Packet ids and outcomes
+  };
+
+  /**
+   * The MAC packets whose retransmission procedure started in an interval.
+   */
+  struct RetransmissionBucket
+  {
+    RetransmissionBucket ();
+
+    int sent;  //!< The number of packets
+    int successful;  //!< The number of packets that were acknowledged
+    std::vector<uint32_t> records;  //!< The index of the packets' records
+  };
+
+  /**
+   * Record the outcome of a packet at a gateway.
+   */
+  void AddPhyOutcome (Ptr<Packet const> packet, uint32_t gwId,
+                      enum PhyPacketOutcome outcome);
+
+  /**
+   * Get the index of the interval a time falls in.
+   */
+  uint32_t GetBucket (Time time) const;
+
+  /**
+   * Get the id of the first packet sent at or after a certain time.
+   */
+  static uint32_t GetFirstId (const std::vector<Time> &sendTimes, Time time);
+
+  /**
+   * Get the id following the last packet sent at or before a certain time.
+   */
+  static uint32_t GetEndId (const std::vector<Time> &sendTimes, Time time);
+
+  Time m_releaseDelay;  //!< How long packets are kept after their transmission
+  Time m_bucketWidth;  //!< The width of the intervals of the counters
+
+  // PHY packets
+  InFlightPackets m_phyInFlight;  //!< PHY packets that can still get outcomes
+  std::vector<Time> m_phySendTimes;  //!< The send time of each PHY packet
+  /**
+   * For each gateway, the outcomes it reported, grouped by the interval in
+   * which the packets were sent.
+   */
+  std::map<int, std::vector<PhyBucket> > m_phyOutcomes;
+
+  // MAC packets
+  InFlightPackets m_macInFlight;  //!< MAC packets that can still be received
+  std::vector<Time> m_macSendTimes;  //!< The send time of each MAC packet
+  std::vector<uint16_t> m_macReceptions;  //!< The gateways that got each packet
+  /**
+   * For each interval, the number of packets sent in it that were received
+   * by at least one gateway.
+   */
+  std::vector<int> m_macReceivedPerBucket;
+
+  // Retransmissions
+  std::vector<Time> m_reTxFirstAttempts;  //!< The first attempt of each packet
+  std::vector<uint8_t> m_reTxAttempts;  //!< The transmissions of each packet
+  std::vector<bool> m_reTxSuccessful;  //!< Whether each packet was acknowledged
+  /**
+   * The retransmission records, grouped by the interval of their first
+   * attempt.
+   */
+  std::vector<RetransmissionBucket> m_reTxBuckets;
 };
 }
 }
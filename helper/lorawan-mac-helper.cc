@@ -32,6 +32,32 @@ NS_LOG_COMPONENT_DEFINE ("LorawanMacHelper");
 
 LorawanMacHelper::LorawanMacHelper () : m_region (LorawanMacHelper::EU)
 {
+  // Channel plans are built only once, and then shared by all the MAC layers
+  // that are configured by this helper
+
+  /////////////////////
+  // EU channel plan //
+  /////////////////////
+  m_euChannelHelper.AddSubBand (868, 868.6, 0.01, 14);
+  m_euChannelHelper.AddSubBand (868.7, 869.2, 0.001, 14);
+  m_euChannelHelper.AddSubBand (869.4, 869.65, 0.1, 27);
+  m_euChannelHelper.AddChannel (CreateObject<LogicalLoraChannel> (868.1, 0, 5));
+  m_euChannelHelper.AddChannel (CreateObject<LogicalLoraChannel> (868.3, 0, 5));
+  m_euChannelHelper.AddChannel (CreateObject<LogicalLoraChannel> (868.5, 0, 5));
+
+  ////////////////////////////////
+  // SINGLECHANNEL channel plan //
+  ////////////////////////////////
+  m_singleChannelHelper.AddSubBand (868, 868.6, 0.01, 14);
+  m_singleChannelHelper.AddSubBand (868.7, 869.2, 0.001, 14);
+  m_singleChannelHelper.AddSubBand (869.4, 869.65, 0.1, 27);
+  m_singleChannelHelper.AddChannel (CreateObject<LogicalLoraChannel> (868.1, 0, 5));
+
+  ////////////////////////
+  // ALOHA channel plan //
+  ////////////////////////
+  m_alohaChannelHelper.AddSubBand (868, 868.6, 1, 14);
+  m_alohaChannelHelper.AddChannel (CreateObject<LogicalLoraChannel> (868.1, 0, 5));
 }
 
 void
@@ -204,20 +230,7 @@ LorawanMacHelper::ApplyCommonAlohaConfigurations (Ptr<LorawanMac> lorawanMac) co
 {
   NS_LOG_FUNCTION_NOARGS ();
 
-  //////////////
-  // SubBands //
-  //////////////
-
-  LogicalLoraChannelHelper channelHelper;
-  channelHelper.AddSubBand (868, 868.6, 1, 14);
-
-  //////////////////////
-  // Default channels //
-  //////////////////////
-  Ptr<LogicalLoraChannel> lc1 = CreateObject<LogicalLoraChannel> (868.1, 0, 5);
-  channelHelper.AddChannel (lc1);
-
-  lorawanMac->SetLogicalLoraChannelHelper (channelHelper);
+  lorawanMac->SetLogicalLoraChannelHelper (m_alohaChannelHelper);
 
   ///////////////////////////////////////////////
   // DataRate -> SF, DataRate -> Bandwidth     //
@@ -310,26 +323,7 @@ LorawanMacHelper::ApplyCommonEuConfigurations (Ptr<LorawanMac> lorawanMac) const
 {
   NS_LOG_FUNCTION_NOARGS ();
 
-  //////////////
-  // SubBands //
-  //////////////
-
-  LogicalLoraChannelHelper channelHelper;
-  channelHelper.AddSubBand (868, 868.6, 0.01, 14);
-  channelHelper.AddSubBand (868.7, 869.2, 0.001, 14);
-  channelHelper.AddSubBand (869.4, 869.65, 0.1, 27);
-
-  //////////////////////
-  // Default channels //
-  //////////////////////
-  Ptr<LogicalLoraChannel> lc1 = CreateObject<LogicalLoraChannel> (868.1, 0, 5);
-  Ptr<LogicalLoraChannel> lc2 = CreateObject<LogicalLoraChannel> (868.3, 0, 5);
-  Ptr<LogicalLoraChannel> lc3 = CreateObject<LogicalLoraChannel> (868.5, 0, 5);
-  channelHelper.AddChannel (lc1);
-  channelHelper.AddChannel (lc2);
-  channelHelper.AddChannel (lc3);
-
-  lorawanMac->SetLogicalLoraChannelHelper (channelHelper);
+  lorawanMac->SetLogicalLoraChannelHelper (m_euChannelHelper);
 
   ///////////////////////////////////////////////
   // DataRate -> SF, DataRate -> Bandwidth     //
@@ -422,22 +416,7 @@ LorawanMacHelper::ApplyCommonSingleChannelConfigurations (Ptr<LorawanMac> lorawa
 {
   NS_LOG_FUNCTION_NOARGS ();
 
-  //////////////
-  // SubBands //
-  //////////////
-
-  LogicalLoraChannelHelper channelHelper;
-  channelHelper.AddSubBand (868, 868.6, 0.01, 14);
-  channelHelper.AddSubBand (868.7, 869.2, 0.001, 14);
-  channelHelper.AddSubBand (869.4, 869.65, 0.1, 27);
-
-  //////////////////////
-  // Default channels //
-  //////////////////////
-  Ptr<LogicalLoraChannel> lc1 = CreateObject<LogicalLoraChannel> (868.1, 0, 5);
-  channelHelper.AddChannel (lc1);
-
-  lorawanMac->SetLogicalLoraChannelHelper (channelHelper);
+  lorawanMac->SetLogicalLoraChannelHelper (m_singleChannelHelper);
 
   ///////////////////////////////////////////////
   // DataRate -> SF, DataRate -> Bandwidth     //
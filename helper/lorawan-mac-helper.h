@@ -107,6 +107,9 @@ public:
    * SF10 -> DR2
    * SF11 -> DR1
    * SF12 -> DR0
+   *
+   * The power received at each gateway is computed by the channel, so that
+   * cached link budgets are reused if the channel is configured to keep them.
    */
   static std::vector<int> SetSpreadingFactorsUp (NodeContainer endDevices, NodeContainer gateways,
                                                  Ptr<LoraChannel> channel);
@@ -170,6 +173,14 @@ private:
   Ptr<LoraDeviceAddressGenerator> m_addrGen; //!< Pointer to the address generator to use
   enum DeviceType m_deviceType; //!< The kind of device to install
   enum Regions m_region; //!< The region in which the device will operate
+
+  /**
+   * The channels and SubBands of each region. These are copied to the MAC
+   * layers being configured, which will all share the same channel plan.
+   */
+  LogicalLoraChannelHelper m_euChannelHelper;
+  LogicalLoraChannelHelper m_singleChannelHelper; //!< \see m_euChannelHelper
+  LogicalLoraChannelHelper m_alohaChannelHelper; //!< \see m_euChannelHelper
 };
 
 } // namespace lorawan
@@ -79,11 +79,11 @@ AdrComponent::~AdrComponent ()
 {
 }
 
-void AdrComponent::OnReceivedPacket (Ptr<const Packet> packet,
+void AdrComponent::OnReceivedPacket (Ptr<const DecodedUplink> uplink,
                                      Ptr<EndDeviceStatus> status,
                                      Ptr<NetworkStatus> networkStatus)
 {
-  NS_LOG_FUNCTION (this->GetTypeId () << packet << networkStatus);
+  NS_LOG_FUNCTION (this->GetTypeId () << uplink->GetPacket () << networkStatus);
 
   // We will only act just before reply, when all Gateways will have received
   // the packet, since we need their respective received power.
@@ -95,19 +95,21 @@ AdrComponent::BeforeSendingReply (Ptr<EndDeviceStatus> status,
 {
   NS_LOG_FUNCTION (this << status << networkStatus);
 
-  Ptr<Packet> myPacket = status->GetLastPacketReceivedFromDevice ()->Copy ();
-  LorawanMacHeader mHdr;
-  LoraFrameHeader fHdr;
-  fHdr.SetAsUplink ();
-  myPacket->RemoveHeader (mHdr);
-  myPacket->RemoveHeader (fHdr);
+  const LoraFrameHeader &fHdr = status->GetLastUplinkReceivedFromDevice ()->GetFrameHeader ();
 
   //Execute the ADR algotithm only if the request bit is set
   if (fHdr.GetAdr ())
     {
-      if (int(status->GetReceivedPacketList ().size ()) < historyRange)
+      // Otherwise, the history would never be long enough
+      NS_ABORT_MSG_IF (status->GetMaxReceivedPackets () < uint32_t (historyRange),
+                       "The MaxReceivedPackets attribute of EndDeviceStatus ("
+                       << status->GetMaxReceivedPackets () << ") must be at least as "
+                       "large as the HistoryRange of AdrComponent ("
+                       << historyRange << ")");
+
+      if (int(status->GetReceivedPacketCount ()) < historyRange)
         {
-          NS_LOG_ERROR ("Not enough packets received by this device (" << status->GetReceivedPacketList ().size () << ") for the algorithm to work (need " << historyRange << ")");
+          NS_LOG_ERROR ("Not enough packets received by this device (" << status->GetReceivedPacketCount () << ") for the algorithm to work (need " << historyRange << ")");
         }
       else
         {
@@ -183,16 +185,13 @@ void AdrComponent::AdrImplementation (uint8_t *newDataRate,
   switch (historyAveraging)
     {
     case AdrComponent::AVERAGE:
-      m_SNR = GetAverageSNR (status->GetReceivedPacketList (),
-                             historyRange);
+      m_SNR = GetAverageSNR (status, historyRange);
       break;
     case AdrComponent::MAXIMUM:
-      m_SNR = GetMaxSNR (status->GetReceivedPacketList (),
-                         historyRange);
+      m_SNR = GetMaxSNR (status, historyRange);
       break;
     case AdrComponent::MINIMUM:
-      m_SNR = GetMinSNR (status->GetReceivedPacketList (),
-                         historyRange);
+      m_SNR = GetMinSNR (status, historyRange);
     }
 
   NS_LOG_DEBUG ("m_SNR = " << m_SNR);
@@ -287,89 +286,38 @@ double AdrComponent::RxPowerToSNR (double transmissionPower)
   return transmissionPower + 174 - 10 * log10 (B) - NF;
 }
 
-//Get the maximum received power (it considers the values in dB!)
-double AdrComponent::GetMinTxFromGateways (EndDeviceStatus::GatewayList gwList)
-{
-  EndDeviceStatus::GatewayList::iterator it = gwList.begin ();
-  double min = it->second.rxPower;
-
-  for (; it != gwList.end (); it++)
-    {
-      if (it->second.rxPower < min)
-        {
-          min = it->second.rxPower;
-        }
-    }
-
-  return min;
-}
-
-//Get the maximum received power (it considers the values in dB!)
-double AdrComponent::GetMaxTxFromGateways (EndDeviceStatus::GatewayList gwList)
-{
-  EndDeviceStatus::GatewayList::iterator it = gwList.begin ();
-  double max = it->second.rxPower;
-
-  for (; it != gwList.end (); it++)
-    {
-      if (it->second.rxPower > max)
-        {
-          max = it->second.rxPower;
-        }
-    }
-
-  return max;
-}
-
-//Get the maximum received power
-double AdrComponent::GetAverageTxFromGateways (EndDeviceStatus::GatewayList gwList)
-{
-  double sum = 0;
-
-  for (EndDeviceStatus::GatewayList::iterator it = gwList.begin (); it != gwList.end (); it++)
-    {
-      NS_LOG_DEBUG ("Gateway at " << it->first << " has TP " << it->second.rxPower);
-      sum += it->second.rxPower;
-    }
-
-  double average = sum / gwList.size ();
-
-  NS_LOG_DEBUG ("TP (average) = " << average);
-
-  return average;
-}
-
 double
-AdrComponent::GetReceivedPower (EndDeviceStatus::GatewayList gwList)
+AdrComponent::GetReceivedPower (const EndDeviceStatus::ReceivedPacketInfo &info)
 {
+  // The combined powers are kept up to date by the EndDeviceStatus as
+  // receptions are added (they consider the values in dB!)
   switch (tpAveraging)
     {
     case AdrComponent::AVERAGE:
-      return GetAverageTxFromGateways (gwList);
+      NS_LOG_DEBUG ("TP (average) = " << info.rxPowerSum / info.gwList.size ());
+      return info.rxPowerSum / info.gwList.size ();
     case AdrComponent::MAXIMUM:
-      return GetMaxTxFromGateways (gwList);
+      return info.maxRxPower;
     case AdrComponent::MINIMUM:
-      return GetMinTxFromGateways (gwList);
+      return info.minRxPower;
     default:
       return -1;
     }
 }
 
-// TODO Make this more elegant
-double AdrComponent::GetMinSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                                int historyRange)
+double AdrComponent::GetMinSNR (Ptr<EndDeviceStatus> status, int historyRange)
 {
   double m_SNR;
 
-  //Take elements from the list starting at the end
-  auto it = packetList.rbegin ();
-  double min = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+  //Take elements from the history starting from the last one
+  double min = RxPowerToSNR (GetReceivedPower (status->GetReceivedPacketInfo (0)));
 
-  for (int i = 0; i < historyRange; i++, it++)
+  for (int i = 0; i < historyRange; i++)
     {
-      m_SNR = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+      double rxPower = GetReceivedPower (status->GetReceivedPacketInfo (i));
+      m_SNR = RxPowerToSNR (rxPower);
 
-      NS_LOG_DEBUG ("Received power: " << GetReceivedPower (it->second.gwList));
+      NS_LOG_DEBUG ("Received power: " << rxPower);
       NS_LOG_DEBUG ("m_SNR = " << m_SNR);
 
       if (m_SNR < min)
@@ -383,20 +331,19 @@ double AdrComponent::GetMinSNR (EndDeviceStatus::ReceivedPacketList packetList,
   return min;
 }
 
-double AdrComponent::GetMaxSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                                int historyRange)
+double AdrComponent::GetMaxSNR (Ptr<EndDeviceStatus> status, int historyRange)
 {
   double m_SNR;
 
-  //Take elements from the list starting at the end
-  auto it = packetList.rbegin ();
-  double max = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+  //Take elements from the history starting from the last one
+  double max = RxPowerToSNR (GetReceivedPower (status->GetReceivedPacketInfo (0)));
 
-  for (int i = 0; i < historyRange; i++, it++)
+  for (int i = 0; i < historyRange; i++)
     {
-      m_SNR = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+      double rxPower = GetReceivedPower (status->GetReceivedPacketInfo (i));
+      m_SNR = RxPowerToSNR (rxPower);
 
-      NS_LOG_DEBUG ("Received power: " << GetReceivedPower (it->second.gwList));
+      NS_LOG_DEBUG ("Received power: " << rxPower);
       NS_LOG_DEBUG ("m_SNR = " << m_SNR);
 
       if (m_SNR > max)
@@ -410,19 +357,18 @@ double AdrComponent::GetMaxSNR (EndDeviceStatus::ReceivedPacketList packetList,
   return max;
 }
 
-double AdrComponent::GetAverageSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                                    int historyRange)
+double AdrComponent::GetAverageSNR (Ptr<EndDeviceStatus> status, int historyRange)
 {
   double sum = 0;
   double m_SNR;
 
-  //Take elements from the list starting at the end
-  auto it = packetList.rbegin ();
-  for (int i = 0; i < historyRange; i++, it++)
+  //Take elements from the history starting from the last one
+  for (int i = 0; i < historyRange; i++)
     {
-      m_SNR = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+      double rxPower = GetReceivedPower (status->GetReceivedPacketInfo (i));
+      m_SNR = RxPowerToSNR (rxPower);
 
-      NS_LOG_DEBUG ("Received power: " << GetReceivedPower (it->second.gwList));
+      NS_LOG_DEBUG ("Received power: " << rxPower);
       NS_LOG_DEBUG ("m_SNR = " << m_SNR);
 
       sum += m_SNR;
@@ -51,7 +51,7 @@ public:
   //Destructor
   virtual ~AdrComponent ();
 
-  void OnReceivedPacket (Ptr<const Packet> packet,
+  void OnReceivedPacket (Ptr<const DecodedUplink> uplink,
                          Ptr<EndDeviceStatus> status,
                          Ptr<NetworkStatus> networkStatus);
 
@@ -69,22 +69,17 @@ private:
 
   double RxPowerToSNR (double transmissionPower);
 
-  double GetMinTxFromGateways (EndDeviceStatus::GatewayList gwList);
+  /**
+   * Combine the reception powers of a packet at the gateways that received
+   * it, according to the MultipleGwCombiningMethod attribute.
+   */
+  double GetReceivedPower (const EndDeviceStatus::ReceivedPacketInfo &info);
 
-  double GetMaxTxFromGateways (EndDeviceStatus::GatewayList gwList);
+  double GetMinSNR (Ptr<EndDeviceStatus> status, int historyRange);
 
-  double GetAverageTxFromGateways (EndDeviceStatus::GatewayList gwList);
+  double GetMaxSNR (Ptr<EndDeviceStatus> status, int historyRange);
 
-  double GetReceivedPower (EndDeviceStatus::GatewayList gwList);
-
-  double GetMinSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                    int historyRange);
-
-  double GetMaxSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                    int historyRange);
-
-  double GetAverageSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                        int historyRange);
+  double GetAverageSNR (Ptr<EndDeviceStatus> status, int historyRange);
 
   int GetTxPowerIndex (int txPower);
 
@@ -19,8 +19,10 @@
 #include "ns3/building-penetration-loss.h"
 #include "ns3/mobility-building-info.h"
 #include "ns3/double.h"
+#include "ns3/boolean.h"
 #include "ns3/log.h"
 #include <cmath>
+#include <functional>
 
 namespace ns3 {
 namespace lorawan {
@@ -36,11 +38,18 @@ BuildingPenetrationLoss::GetTypeId (void)
     .SetParent<PropagationLossModel> ()
     .SetGroupName ("Lora")
     .AddConstructor<BuildingPenetrationLoss> ()
+    .AddAttribute ("FixedLinkLoss",
+                   "Whether to draw the loss between each pair of mobility models "
+                   "only once, and reuse it for all the following calls.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&BuildingPenetrationLoss::m_fixedLinkLoss),
+                   MakeBooleanChecker ())
   ;
   return tid;
 }
 
-BuildingPenetrationLoss::BuildingPenetrationLoss ()
+BuildingPenetrationLoss::BuildingPenetrationLoss () :
+  m_fixedLinkLoss (false)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
@@ -60,6 +69,29 @@ BuildingPenetrationLoss::DoCalcRxPower (double txPowerDbm,
 {
   NS_LOG_FUNCTION (this << txPowerDbm << a << b);
 
+  if (!m_fixedLinkLoss)
+    {
+      return txPowerDbm - GetLoss (a, b);
+    }
+
+  // Only draw the loss the first time the link is used
+  std::pair<std::unordered_map<Link, double, LinkHash>::iterator, bool> link =
+    m_linkLossMap.insert (std::make_pair (Link (a, b), 0.0));
+  if (link.second)
+    {
+      link.first->second = GetLoss (a, b);
+      NS_LOG_DEBUG ("Fixed the loss of a new link: " << link.first->second);
+    }
+
+  return txPowerDbm - link.first->second;
+}
+
+double
+BuildingPenetrationLoss::GetLoss (Ptr<MobilityModel> a,
+                                  Ptr<MobilityModel> b) const
+{
+  NS_LOG_FUNCTION (this << a << b);
+
   Ptr<MobilityBuildingInfo> a1 = a->GetObject<MobilityBuildingInfo> ();
   Ptr<MobilityBuildingInfo> b1 = b->GetObject<MobilityBuildingInfo> ();
 
@@ -127,7 +159,21 @@ BuildingPenetrationLoss::DoCalcRxPower (double txPowerDbm,
 
   NS_LOG_DEBUG ("Total loss due to building penetration: " << loss);
 
-  return txPowerDbm - loss;
+  return loss;
+}
+
+std::size_t
+BuildingPenetrationLoss::MobilityModelHash::operator()
+  (const Ptr<MobilityModel> &mobility) const
+{
+  return std::hash<const MobilityModel *> () (PeekPointer (mobility));
+}
+
+std::size_t
+BuildingPenetrationLoss::LinkHash::operator() (const Link &link) const
+{
+  MobilityModelHash hash;
+  return hash (link.first) * 31 + hash (link.second);
 }
 
 int64_t
@@ -192,19 +238,17 @@ BuildingPenetrationLoss::GetWallLoss (Ptr<MobilityModel> b) const
 {
   NS_LOG_FUNCTION (this << b);
 
-  std::map<Ptr<MobilityModel>, int>::const_iterator it;
-
   // Check whether the b device already has a wall loss value
-  it = m_wallLossMap.find (b);
-  if (it == m_wallLossMap.end ())
+  std::pair<std::unordered_map<Ptr<MobilityModel>, int, MobilityModelHash>::iterator,
+            bool> it = m_wallLossMap.insert (std::make_pair (b, 0));
+  if (it.second)
     {
       // Create a random value and insert it on the map
-      m_wallLossMap[b] = GetWallLossValue ();
-      NS_LOG_DEBUG ("Inserted a new wall loss value: " <<
-                    m_wallLossMap.find (b)->second);
+      it.first->second = GetWallLossValue ();
+      NS_LOG_DEBUG ("Inserted a new wall loss value: " << it.first->second);
     }
 
-  switch (m_wallLossMap.find (b)->second)
+  switch (it.first->second)
     {
     case 0:
       return m_uniformRV->GetValue (4, 11);
@@ -223,17 +267,16 @@ BuildingPenetrationLoss::GetTor1 (Ptr<MobilityModel> b) const
 {
   NS_LOG_FUNCTION (this << b);
 
-  std::map<Ptr<MobilityModel>, int>::const_iterator it;
-
   // Check whether the b device already has a p value
-  it = m_pMap.find (b);
-  if (it == m_pMap.end ())
+  std::pair<std::unordered_map<Ptr<MobilityModel>, int, MobilityModelHash>::iterator,
+            bool> it = m_pMap.insert (std::make_pair (b, 0));
+  if (it.second)
     {
       // Create a random p value and insert it on the map
-      m_pMap[b] = GetPValue ();
-      NS_LOG_DEBUG ("Inserted a new p value: " << m_pMap.find (b)->second);
+      it.first->second = GetPValue ();
+      NS_LOG_DEBUG ("Inserted a new p value: " << it.first->second);
     }
-  return m_uniformRV->GetValue (4, 10) * m_pMap.find (b)->second;
+  return m_uniformRV->GetValue (4, 10) * it.first->second;
 }
 }
 }
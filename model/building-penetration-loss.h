@@ -23,6 +23,8 @@
 #include "ns3/mobility-model.h"
 #include "ns3/vector.h"
 #include "ns3/random-variable-stream.h"
+#include <unordered_map>
+#include <utility>
 
 namespace ns3 {
 class MobilityModel;
@@ -31,6 +33,10 @@ namespace lorawan {
 
 /**
  * A class implementing the TR 45.820 model for building losses
+ *
+ * By default, the random components of the loss are drawn again at every
+ * call. If the FixedLinkLoss attribute is set, the loss of each link is
+ * drawn only once, and then reused for all the following calls.
  */
 class BuildingPenetrationLoss : public PropagationLossModel
 {
@@ -82,18 +88,52 @@ private:
    */
   double GetTor1 (Ptr<MobilityModel> b) const;
 
+  /**
+   * Draw the building penetration loss between two mobility models.
+   * \returns The loss, in dB.
+   */
+  double GetLoss (Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+
+  /**
+   * Hash a mobility model by the address of the object it points to.
+   */
+  struct MobilityModelHash
+  {
+    std::size_t operator() (const Ptr<MobilityModel> &mobility) const;
+  };
+
+  /**
+   * The mobility models at the two ends of a link.
+   */
+  typedef std::pair<Ptr<MobilityModel>, Ptr<MobilityModel> > Link;
+
+  /**
+   * Hash a link.
+   */
+  struct LinkHash
+  {
+    std::size_t operator() (const Link &link) const;
+  };
+
   Ptr<UniformRandomVariable> m_uniformRV;     //!< An uniform RV
 
+  bool m_fixedLinkLoss;     //!< Whether to draw the loss of each link only once
+
   /**
    * A map linking each mobility model to a p value
    */
-  mutable std::map<Ptr<MobilityModel>, int> m_pMap;
+  mutable std::unordered_map<Ptr<MobilityModel>, int, MobilityModelHash> m_pMap;
 
   /**
    * A map linking each mobility model to a value deciding its external wall
    * loss.
    */
-  mutable std::map<Ptr<MobilityModel>, int> m_wallLossMap;
+  mutable std::unordered_map<Ptr<MobilityModel>, int, MobilityModelHash> m_wallLossMap;
+
+  /**
+   * A map linking each link to its loss, used if m_fixedLinkLoss is set.
+   */
+  mutable std::unordered_map<Link, double, LinkHash> m_linkLossMap;
 };
 }
 }
@@ -102,7 +102,12 @@ ClassAEndDeviceLorawanMac::SendToPhy (Ptr<Packet> packetToSend)
 
   // Wake up PHY layer and directly send the packet
 
-  Ptr<LogicalLoraChannel> txChannel = GetChannelForTx ();
+  // Use the channel that was picked by Send, if any
+  Ptr<LogicalLoraChannel> txChannel = m_txChannel;
+  if (!txChannel)
+    {
+      txChannel = GetChannelForTx ();
+    }
 
   NS_LOG_DEBUG ("PacketToSend: " << packetToSend);
   m_phy->Send (packetToSend, params, txChannel->GetFrequency (), m_txPower);
@@ -144,12 +149,8 @@ ClassAEndDeviceLorawanMac::Receive (Ptr<Packet const> packet)
 {
   NS_LOG_FUNCTION (this << packet);
 
-  // Work on a copy of the packet
-  Ptr<Packet> packetCopy = packet->Copy ();
-
-  // Remove the Mac Header to get some information
-  LorawanMacHeader mHdr;
-  packetCopy->RemoveHeader (mHdr);
+  // Read the Mac Header to get some information
+  LorawanMacHeader mHdr = LorawanMacHeader::Peek (packet);
 
   NS_LOG_DEBUG ("Mac Header: " << mHdr);
 
@@ -158,6 +159,10 @@ ClassAEndDeviceLorawanMac::Receive (Ptr<Packet const> packet)
     {
       NS_LOG_INFO ("Found a downlink packet.");
 
+      // Work on a copy of the packet
+      Ptr<Packet> packetCopy = packet->Copy ();
+      packetCopy->RemoveHeader (mHdr);
+
       // Remove the Frame Header
       LoraFrameHeader fHdr;
       fHdr.SetAsDownlink ();
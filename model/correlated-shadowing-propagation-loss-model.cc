@@ -18,8 +18,10 @@
 
 #include "ns3/correlated-shadowing-propagation-loss-model.h"
 #include "ns3/double.h"
+#include "ns3/uinteger.h"
 #include "ns3/log.h"
 #include <cmath>
+#include <functional>
 
 namespace ns3 {
 namespace lorawan {
@@ -40,15 +42,60 @@ CorrelatedShadowingPropagationLossModel::GetTypeId (void)
                    "uncorrelated",
                    DoubleValue (110.0),
                    MakeDoubleAccessor
-                     (&CorrelatedShadowingPropagationLossModel::m_correlationDistance),
-                   MakeDoubleChecker<double> ());
+                     (&CorrelatedShadowingPropagationLossModel::SetCorrelationDistance,
+                     &CorrelatedShadowingPropagationLossModel::GetCorrelationDistance),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("MaxCachedPositions",
+                   "The maximum number of receiver positions each shadowing map "
+                   "keeps the loss of, discarding the least recently used ones. "
+                   "Discarded values are recomputed identically if needed. "
+                   "0 means there is no limit.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor
+                     (&CorrelatedShadowingPropagationLossModel::m_maxCachedPositions),
+                   MakeUintegerChecker<uint32_t> ());
   return tid;
 }
 
-CorrelatedShadowingPropagationLossModel::CorrelatedShadowingPropagationLossModel ()
+CorrelatedShadowingPropagationLossModel::CorrelatedShadowingPropagationLossModel () :
+  m_correlationDistance (110),
+  m_maxCachedPositions (0)
 {
 }
 
+void
+CorrelatedShadowingPropagationLossModel::SetCorrelationDistance (double distance)
+{
+  // The grid squares and the maps' vertices depend on the distance, so the
+  // maps that were already created can't be used anymore
+  if (distance != m_correlationDistance)
+    {
+      m_shadowingGrid.clear ();
+    }
+  m_correlationDistance = distance;
+}
+
+double
+CorrelatedShadowingPropagationLossModel::GetCorrelationDistance (void) const
+{
+  return m_correlationDistance;
+}
+
+int
+CorrelatedShadowingPropagationLossModel::GetSquareCoordinate (double x,
+                                                              double correlationDistance)
+{
+  // Round the raw position to the closest multiple of the correlation
+  // distance. (x > 0) - (x < 0) is the sign function.
+  return ((x > 0) - (x < 0)) * ((std::fabs (x) + correlationDistance / 2) / correlationDistance);
+}
+
+uint64_t
+CorrelatedShadowingPropagationLossModel::GetKey (int x, int y)
+{
+  return uint64_t (uint32_t (x)) << 32 | uint32_t (y);
+}
+
 double
 CorrelatedShadowingPropagationLossModel::DoCalcRxPower (double txPowerDbm,
                                                         Ptr<MobilityModel> a,
@@ -62,53 +109,37 @@ CorrelatedShadowingPropagationLossModel::DoCalcRxPower (double txPowerDbm,
    */
   Vector position = a->GetPosition ();
 
-  double x = position.x;
-  double y = position.y;
-
   // Compute the coordinates of the grid square (i.e., round the raw position)
-  // (x > 0) - (x < 0) is the sign function
-  int xcoord =
-    ((x > 0) - (x < 0)) * ((std::fabs (x) + m_correlationDistance / 2) / m_correlationDistance);
-  int ycoord =
-    ((y > 0) - (y < 0)) * ((std::fabs (y) + m_correlationDistance / 2) / m_correlationDistance);
-
-  // Wrap coordinates up in a pair
-  std::pair<int, int> coordinates (xcoord, ycoord);
+  int xcoord = GetSquareCoordinate (position.x, m_correlationDistance);
+  int ycoord = GetSquareCoordinate (position.y, m_correlationDistance);
 
-  NS_LOG_DEBUG ("x " << x << ", y " << y);
+  NS_LOG_DEBUG ("x " << position.x << ", y " << position.y);
   NS_LOG_DEBUG ("xcoord " << xcoord << ", ycoord " << ycoord);
 
-  // Look for the computed coordinates in the shadowingGrid
-  std::map<std::pair<int,int>, Ptr<ShadowingMap> >::const_iterator it;
+  // Look for the computed coordinates in the shadowingGrid, creating the
+  // square's ShadowingMap if it's not there
+  Ptr<ShadowingMap> &shadowingMap = m_shadowingGrid[GetKey (xcoord, ycoord)];
 
-  it = m_shadowingGrid.find (coordinates);
-
-  if (it == m_shadowingGrid.end ())     // Did not find the coordinates
+  if (shadowingMap == 0)
     {
-      // If this shadowing grid was not found, create it
       NS_LOG_DEBUG ("Creating a new shadowing map to be used at coordinates "
-                    << coordinates.first << " " << coordinates.second);
-
-      Ptr<ShadowingMap> shadowingMap =
-        Create<CorrelatedShadowingPropagationLossModel::ShadowingMap> ();
+                    << xcoord << " " << ycoord);
 
-      m_shadowingGrid[coordinates] = shadowingMap;
+      shadowingMap = Create<CorrelatedShadowingPropagationLossModel::ShadowingMap>
+          (m_correlationDistance, m_maxCachedPositions);
     }
   else
     {
       NS_LOG_DEBUG ("This square already has its shadowingMap!");
     }
 
-  // Place the iterator on the coordinates
-  it = m_shadowingGrid.find (coordinates);
-
   // Get b's position in a's ShadowingMap
   CorrelatedShadowingPropagationLossModel::Position bPosition
     (b->GetPosition ().x, b->GetPosition ().y);
 
   // Use the map of the a MobilityModel to determine the value of shadowing
   // that corresponds to the position of the MobilityModel b.
-  double loss = it->second->GetLoss (bPosition);
+  double loss = shadowingMap->GetLoss (bPosition);
 
   NS_LOG_INFO ("Shadowing loss: " << loss);
 
@@ -134,8 +165,10 @@ const double CorrelatedShadowingPropagationLossModel::ShadowingMap::m_kInv[4][4]
   {-0.366414485833771, -0.0415206295795327, -0.366414485833771, 1.27968707244633}
 };
 
-CorrelatedShadowingPropagationLossModel::ShadowingMap::ShadowingMap () :
-  m_correlationDistance (110)
+CorrelatedShadowingPropagationLossModel::ShadowingMap::ShadowingMap
+  (double correlationDistance, uint32_t maxCachedPositions) :
+  m_maxCachedPositions (maxCachedPositions),
+  m_correlationDistance (correlationDistance)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
@@ -151,110 +184,131 @@ CorrelatedShadowingPropagationLossModel::ShadowingMap::~ShadowingMap ()
   NS_LOG_FUNCTION_NOARGS ();
 }
 
+std::size_t
+CorrelatedShadowingPropagationLossModel::ShadowingMap::PositionKeyHash::operator()
+  (const PositionKey &key) const
+{
+  std::hash<double> hash;
+  return hash (key.first) * 31 + hash (key.second);
+}
+
+double
+CorrelatedShadowingPropagationLossModel::ShadowingMap::GetVertexValue (int i, int j)
+{
+  std::pair<std::unordered_map<uint64_t, double>::iterator, bool> vertex =
+    m_vertices.insert (std::make_pair (GetKey (i, j), 0.0));
+
+  // Only generate the value the first time the vertex is used
+  if (vertex.second)
+    {
+      vertex.first->second = m_shadowingValue->GetValue ();
+    }
+
+  return vertex.first->second;
+}
+
 double
 CorrelatedShadowingPropagationLossModel::ShadowingMap::GetLoss
   (CorrelatedShadowingPropagationLossModel::Position position)
 {
   NS_LOG_FUNCTION (this << position.x << position.y);
 
-  // Verify whether this position is already in the shadowingMap. Since the
-  // Position implementation overloads the == operator, this comparison
-  // between doubles is ok and we can use std::map's find function.
-  std::map<CorrelatedShadowingPropagationLossModel::Position,
-           double>::const_iterator it;
-  it = m_shadowingMap.find (position);
+  // Verify whether this position is already in the shadowingMap
+  PositionKey key (position.x, position.y);
+  std::unordered_map<PositionKey, CachedLoss, PositionKeyHash>::iterator it =
+    m_shadowingMap.find (key);
 
-  // If it's not found (i.e, if find returns the end of the map), we need to
-  // generate the value at the specified position.
-  if (it == m_shadowingMap.end ())
+  if (it != m_shadowingMap.end ())
     {
-      // Get the coordinates of the position
-      double x = position.x;
-      double y = position.y;
-      int xcoord =
-        ((x > 0) - (x < 0)) * ((std::fabs (x) + m_correlationDistance / 2) / m_correlationDistance);
-      int ycoord =
-        ((y > 0) - (y < 0)) * ((std::fabs (y) + m_correlationDistance / 2) / m_correlationDistance);
-
-      // Verify whether there already are the 4 surrounding positions in the
-      // map
-      double xmin = xcoord * m_correlationDistance - m_correlationDistance / 2;
-      double xmax = xcoord * m_correlationDistance + m_correlationDistance / 2;
-      double ymin = ycoord * m_correlationDistance - m_correlationDistance / 2;
-      double ymax = ycoord * m_correlationDistance + m_correlationDistance / 2;
-
-      CorrelatedShadowingPropagationLossModel::Position lowerLeft (xmin, ymin);
-      CorrelatedShadowingPropagationLossModel::Position upperLeft (xmin, ymax);
-      CorrelatedShadowingPropagationLossModel::Position lowerRight (xmax, ymin);
-      CorrelatedShadowingPropagationLossModel::Position upperRight (xmax, ymax);
-
-      NS_LOG_DEBUG ("Generating a new shadowing value in the following quadrant:");
-      NS_LOG_DEBUG ("xmin " << xmin << ", xmax " << xmax <<
-                    ", ymin " << ymin << ", ymax " << ymax);
-
-      // Use the map's insert method to insert the coordinates of the 4
-      // surrounding positions (if they are already there, they won't be
-      // substituted thanks to the map's implementation).
-      // TODO: Avoid useless generation of ShadowingMap values. This can be
-      // done by performing some checks (and not leveraging the map
-      // implementation)
-      double q11 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Lower left corner: " << q11);
-      m_shadowingMap[lowerLeft] = q11;
-      double q12 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Upper left corner: " << q12);
-      m_shadowingMap[upperLeft] = q12;
-      double q21 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Lower right corner: " << q21);
-      m_shadowingMap[lowerRight] = q21;
-      double q22 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Upper right corner: " << q22);
-      m_shadowingMap[upperRight] = q22;
-
-      NS_LOG_DEBUG (q11 << " " << q12 << " " << q21 << " " << q22 << " ");
-
-      // The c matrix contains the positions of the 4 vertices
-      double c[2][4] = {{xmin, xmax, xmax, xmin}, {ymin, ymin, ymax, ymax}};
-
-      // For the following procedure, reference:
-      // S. Schlegel et al., "On the Interpolation of Data with Normally
-      // Distributed Uncertainty for Visualization", IEEE Transactions on
-      // Visualization and Computer Graphics, vol. 18, no. 12, Dec. 2012.
-
-      // Compute the phi coefficients
-      double phi1 = 0;
-      double phi2 = 0;
-      double phi3 = 0;
-      double phi4 = 0;
-
-      for (int j = 0; j < 4; j++)
-        {
-          double distance = sqrt ((c[0][j] - x) * (c[0][j] - x) + (c[1][j] - y) * (c[1][j] - y));
-
-          NS_LOG_DEBUG ("Distance: " << distance);
+      NS_LOG_DEBUG ("Shadowing map for this location already exists");
 
-          double k = std::exp (-distance / m_correlationDistance);
-          phi1 = phi1 + m_kInv[0][j] * k;
-          phi2 = phi2 + m_kInv[1][j] * k;
-          phi3 = phi3 + m_kInv[2][j] * k;
-          phi4 = phi4 + m_kInv[3][j] * k;
+      // Mark the position as the most recently used one
+      if (m_maxCachedPositions > 0)
+        {
+          m_recentPositions.splice (m_recentPositions.begin (), m_recentPositions,
+                                    it->second.second);
         }
 
-      NS_LOG_DEBUG ("Phi: " << phi1 << " " << phi2 << " " << phi3 << " " <<
-                    phi4 << " ");
+      return it->second.first;
+    }
+
+  // Get the coordinates of the position
+  double x = position.x;
+  double y = position.y;
+  int xcoord = GetSquareCoordinate (x, m_correlationDistance);
+  int ycoord = GetSquareCoordinate (y, m_correlationDistance);
+
+  // Get the 4 surrounding positions
+  double xmin = xcoord * m_correlationDistance - m_correlationDistance / 2;
+  double xmax = xcoord * m_correlationDistance + m_correlationDistance / 2;
+  double ymin = ycoord * m_correlationDistance - m_correlationDistance / 2;
+  double ymax = ycoord * m_correlationDistance + m_correlationDistance / 2;
+
+  NS_LOG_DEBUG ("Generating a new shadowing value in the following quadrant:");
+  NS_LOG_DEBUG ("xmin " << xmin << ", xmax " << xmax <<
+                ", ymin " << ymin << ", ymax " << ymax);
+
+  // Get the values at the 4 surrounding positions. Vertices that are shared
+  // with squares that were already used keep their value.
+  double q11 = GetVertexValue (xcoord, ycoord);
+  NS_LOG_DEBUG ("Lower left corner: " << q11);
+  double q12 = GetVertexValue (xcoord, ycoord + 1);
+  NS_LOG_DEBUG ("Upper left corner: " << q12);
+  double q21 = GetVertexValue (xcoord + 1, ycoord);
+  NS_LOG_DEBUG ("Lower right corner: " << q21);
+  double q22 = GetVertexValue (xcoord + 1, ycoord + 1);
+  NS_LOG_DEBUG ("Upper right corner: " << q22);
+
+  NS_LOG_DEBUG (q11 << " " << q12 << " " << q21 << " " << q22 << " ");
+
+  // The c matrix contains the positions of the 4 vertices
+  double c[2][4] = {{xmin, xmax, xmax, xmin}, {ymin, ymin, ymax, ymax}};
+
+  // For the following procedure, reference:
+  // S. Schlegel et al., "On the Interpolation of Data with Normally
+  // Distributed Uncertainty for Visualization", IEEE Transactions on
+  // Visualization and Computer Graphics, vol. 18, no. 12, Dec. 2012.
+
+  // Compute the phi coefficients
+  double phi1 = 0;
+  double phi2 = 0;
+  double phi3 = 0;
+  double phi4 = 0;
+
+  for (int j = 0; j < 4; j++)
+    {
+      double distance = sqrt ((c[0][j] - x) * (c[0][j] - x) + (c[1][j] - y) * (c[1][j] - y));
 
-      double shadowing = q11 * phi1 + q21 * phi2 + q22 * phi3 + q12 * phi4;
+      NS_LOG_DEBUG ("Distance: " << distance);
 
-      // Add the newly computed shadowing value to the shadowing map
-      m_shadowingMap[position] = shadowing;
-      NS_LOG_DEBUG ("Created new shadowing map: " << shadowing);
+      double k = std::exp (-distance / m_correlationDistance);
+      phi1 = phi1 + m_kInv[0][j] * k;
+      phi2 = phi2 + m_kInv[1][j] * k;
+      phi3 = phi3 + m_kInv[2][j] * k;
+      phi4 = phi4 + m_kInv[3][j] * k;
     }
-  else
+
+  NS_LOG_DEBUG ("Phi: " << phi1 << " " << phi2 << " " << phi3 << " " <<
+                phi4 << " ");
+
+  double shadowing = q11 * phi1 + q21 * phi2 + q22 * phi3 + q12 * phi4;
+
+  // Add the newly computed shadowing value to the shadowing map, making
+  // room for it if needed
+  std::list<PositionKey>::iterator recent = m_recentPositions.end ();
+  if (m_maxCachedPositions > 0)
     {
-      NS_LOG_DEBUG ("Shadowing map for this location already exists");
+      if (m_shadowingMap.size () >= m_maxCachedPositions)
+        {
+          m_shadowingMap.erase (m_recentPositions.back ());
+          m_recentPositions.pop_back ();
+        }
+      recent = m_recentPositions.insert (m_recentPositions.begin (), key);
     }
+  m_shadowingMap[key] = CachedLoss (shadowing, recent);
+  NS_LOG_DEBUG ("Created new shadowing map: " << shadowing);
 
-  return m_shadowingMap[position];
+  return shadowing;
 }
 
 /*****************************
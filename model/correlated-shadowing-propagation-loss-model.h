@@ -23,6 +23,9 @@
 #include "ns3/mobility-model.h"
 #include "ns3/vector.h"
 #include "ns3/random-variable-stream.h"
+#include <list>
+#include <unordered_map>
+#include <utility>
 
 namespace ns3 {
 class MobilityModel;
@@ -67,8 +70,17 @@ public:
      *  twice. Also, since interpolation is a deterministic operation, we are
      *  guaranteed that, as long as the grid doesn't change, also two values
      *  generated in the same square will be correlated.
+     *
+     *  The values at the vertices of the grid are only generated the first
+     *  time a square that has them as a vertex is used, and are then shared
+     *  with the adjacent squares.
+     *
+     *  \param correlationDistance The distance between the vertices of the
+     *  grid.
+     *  \param maxCachedPositions The maximum number of positions whose loss
+     *  is kept in the map, or 0 to keep all of them.
      */
-    ShadowingMap ();
+    ShadowingMap (double correlationDistance = 110, uint32_t maxCachedPositions = 0);
 
     ~ShadowingMap ();
 
@@ -81,12 +93,56 @@ public:
 
 private:
     /**
-     * For each Position, this map gives a corresponding loss.
-     * The map contains a basic grid that is initialized at construction
-     * time, and then newly computed values are added as they are created.
+     * The coordinates of a position, compared exactly.
      */
-    std::map<CorrelatedShadowingPropagationLossModel::Position, double>
-    m_shadowingMap;
+    typedef std::pair<double, double> PositionKey;
+
+    /**
+     * Hash function for PositionKey.
+     */
+    struct PositionKeyHash
+    {
+      std::size_t operator() (const PositionKey &key) const;
+    };
+
+    /**
+     * The loss at a position, and the position's place in m_recentPositions.
+     */
+    typedef std::pair<double, std::list<PositionKey>::iterator> CachedLoss;
+
+    /**
+     * Get the shadowing value at a vertex of the grid, generating it if it
+     * doesn't exist yet.
+     *
+     * \param i The index of the vertex along the x axis.
+     * \param j The index of the vertex along the y axis.
+     * \return The shadowing value.
+     */
+    double GetVertexValue (int i, int j);
+
+    /**
+     * The shadowing values at the vertices of the grid, indexed by the packed
+     * indices of the vertex. Vertex (i, j) is the lower left vertex of square
+     * (i, j).
+     */
+    std::unordered_map<uint64_t, double> m_vertices;
+
+    /**
+     * For each position, the loss that was computed for it.
+     */
+    std::unordered_map<PositionKey, CachedLoss, PositionKeyHash> m_shadowingMap;
+
+    /**
+     * The positions in m_shadowingMap, from the most to the least recently
+     * used. This is only kept if the number of positions is limited.
+     */
+    std::list<PositionKey> m_recentPositions;
+
+    /**
+     * The maximum number of positions in m_shadowingMap, or 0 if there is no
+     * limit.
+     */
+    uint32_t m_maxCachedPositions;
 
     /**
      * The distance after which two samples are to be considered almost
@@ -115,14 +171,17 @@ private:
   CorrelatedShadowingPropagationLossModel ();
 
   /**
-   * Set the correlation distance for newly created ShadowingMap instances
+   * Set the correlation distance of the shadowing grid.
+   *
+   * If the distance changes, the ShadowingMap instances that were already
+   * created are discarded, and new ones are generated when needed.
    */
   void SetCorrelationDistance (double distance);
 
   /**
    * Get the correlation distance that is currently being used.
    */
-  double GetCorrelationDistance (void);
+  double GetCorrelationDistance (void) const;
 
 private:
   virtual double DoCalcRxPower (double txPowerDbm,
@@ -131,8 +190,28 @@ private:
 
   virtual int64_t DoAssignStreams (int64_t stream);
 
+  /**
+   * Get the coordinate of the grid square a position falls in, along one
+   * axis.
+   *
+   * \param x The position along the axis.
+   * \param correlationDistance The side of the grid squares.
+   * \return The coordinate of the square.
+   */
+  static int GetSquareCoordinate (double x, double correlationDistance);
+
+  /**
+   * Pack the two coordinates of a grid square or vertex in a single key.
+   */
+  static uint64_t GetKey (int x, int y);
+
   double m_correlationDistance;     //!< The correlation distance for the ShadowingMap
 
+  /**
+   * The maximum number of positions each ShadowingMap keeps the loss of.
+   */
+  uint32_t m_maxCachedPositions;
+
   /**
    * Map linking a square to a ShadowingMap.
    * Each square of the shadowing grid has a corresponding ShadowingMap, and a
@@ -169,8 +248,10 @@ private:
    *  Further, the ShadowingMap will be "smooth": when transmitting from point
    *  a to points b and c, the shadowing experienced by b and c will be similar
    *  if they are close (ideally, within a correlation distance).
+   *
+   *  Squares are indexed by the packed pair of their coordinates.
    */
-  mutable std::map<std::pair<int, int>, Ptr<ShadowingMap> > m_shadowingGrid;
+  mutable std::unordered_map<uint64_t, Ptr<ShadowingMap> > m_shadowingGrid;
 };
 
 }
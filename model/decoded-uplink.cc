@@ -0,0 +1,82 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2018 University of Padova
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/decoded-uplink.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("DecodedUplink");
+
+DecodedUplink::DecodedUplink (Ptr<const Packet> packet) :
+  m_packet (packet)
+{
+  NS_LOG_FUNCTION (this << packet);
+
+  // The frame header can only be read after the MAC header is removed, so a
+  // copy is needed. This is the only one made for this packet at the server.
+  Ptr<Packet> myPacket = packet->Copy ();
+  myPacket->RemoveHeader (m_macHeader);
+  m_frameHeader.SetAsUplink ();
+  myPacket->RemoveHeader (m_frameHeader);
+
+  packet->PeekPacketTag (m_tag);
+
+  NS_LOG_DEBUG ("Mac Header: " << m_macHeader);
+  NS_LOG_DEBUG ("Frame Header: " << m_frameHeader);
+}
+
+Ptr<const Packet>
+DecodedUplink::GetPacket (void) const
+{
+  return m_packet;
+}
+
+const LorawanMacHeader &
+DecodedUplink::GetMacHeader (void) const
+{
+  return m_macHeader;
+}
+
+const LoraFrameHeader &
+DecodedUplink::GetFrameHeader (void) const
+{
+  return m_frameHeader;
+}
+
+const LoraTag &
+DecodedUplink::GetTag (void) const
+{
+  return m_tag;
+}
+
+LoraDeviceAddress
+DecodedUplink::GetAddress (void) const
+{
+  return m_frameHeader.GetAddress ();
+}
+
+uint16_t
+DecodedUplink::GetFCnt (void) const
+{
+  return m_frameHeader.GetFCnt ();
+}
+
+} // namespace lorawan
+} // namespace ns3
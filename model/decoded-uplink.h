@@ -0,0 +1,90 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2018 University of Padova
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef DECODED_UPLINK_H
+#define DECODED_UPLINK_H
+
+#include "ns3/simple-ref-count.h"
+#include "ns3/packet.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/lora-frame-header.h"
+#include "ns3/lora-device-address.h"
+#include "ns3/lora-tag.h"
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * An uplink packet received by the Network Server, together with its
+ * deserialized headers and LoraTag.
+ *
+ * Headers are parsed once, when the packet reaches the Network Server, and
+ * this object is then handed to the NetworkScheduler, the NetworkStatus and
+ * all NetworkController components, which only need to read them.
+ */
+class DecodedUplink : public SimpleRefCount<DecodedUplink>
+{
+public:
+  /**
+   * Decode an uplink packet.
+   *
+   * \param packet The packet, starting with its LorawanMacHeader.
+   */
+  DecodedUplink (Ptr<const Packet> packet);
+
+  /**
+   * Get the packet as it was received, with all its headers.
+   */
+  Ptr<const Packet> GetPacket (void) const;
+
+  /**
+   * Get the MAC header of the packet.
+   */
+  const LorawanMacHeader &GetMacHeader (void) const;
+
+  /**
+   * Get the frame header of the packet.
+   */
+  const LoraFrameHeader &GetFrameHeader (void) const;
+
+  /**
+   * Get the LoraTag the gateway attached to the packet.
+   */
+  const LoraTag &GetTag (void) const;
+
+  /**
+   * Get the address of the device that sent the packet.
+   */
+  LoraDeviceAddress GetAddress (void) const;
+
+  /**
+   * Get the frame counter of the packet.
+   */
+  uint16_t GetFCnt (void) const;
+
+private:
+  Ptr<const Packet> m_packet;  //!< The received packet
+  LorawanMacHeader m_macHeader;  //!< The MAC header of the packet
+  LoraFrameHeader m_frameHeader;  //!< The frame header of the packet
+  LoraTag m_tag;  //!< The tag of the packet
+};
+
+} // namespace lorawan
+
+} // namespace ns3
+#endif /* DECODED_UPLINK_H */
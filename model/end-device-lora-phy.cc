@@ -119,6 +119,13 @@ EndDeviceLoraPhy::SwitchToStandby (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
+  // Receive transmissions from the channel while in STANDBY. In RX we kept
+  // listening, so that new transmissions interfere with the reception.
+  if (m_state != STANDBY && m_state != RX && m_channel != 0)
+    {
+      m_channel->StartListening (this);
+    }
+
   m_state = STANDBY;
 
   // Notify listeners of the state change
@@ -151,6 +158,11 @@ EndDeviceLoraPhy::SwitchToTx (double txPowerDbm)
 
   NS_ASSERT (m_state != RX);
 
+  if (m_state == STANDBY && m_channel != 0)
+    {
+      m_channel->StopListening (this);
+    }
+
   m_state = TX;
 
   // Notify listeners of the state change
@@ -167,6 +179,11 @@ EndDeviceLoraPhy::SwitchToSleep (void)
 
   NS_ASSERT (m_state == STANDBY);
 
+  if (m_channel != 0)
+    {
+      m_channel->StopListening (this);
+    }
+
   m_state = SLEEP;
 
   // Notify listeners of the state change
@@ -148,11 +148,13 @@ public:
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                             uint8_t sf, Time duration, double frequencyMHz) = 0;
+                             uint8_t sf, Time duration, double frequencyMHz,
+                             Ptr<LoraInterferenceHelper::Event> event) = 0;
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void EndReceive (Ptr<Packet> packet,
-                           Ptr<LoraInterferenceHelper::Event> event) = 0;
+                           Ptr<LoraInterferenceHelper::Event> event,
+                           double rxPowerDbm) = 0;
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void Send (Ptr<Packet> packet, LoraTxParameters txParams,
@@ -187,7 +187,11 @@ EndDeviceLorawanMac::Send (Ptr<Packet> packet)
       // Make sure we can transmit at the current power on this channel
       NS_ASSERT_MSG (m_txPower <= m_channelHelper.GetTxPowerForChannel (txChannel),
                      " The selected power is too hight to be supported by this channel.");
+
+      // Let SendToPhy use the channel we just picked
+      m_txChannel = txChannel;
       DoSend (packet);
+      m_txChannel = 0;
     }
 }
 
@@ -529,27 +533,11 @@ EndDeviceLorawanMac::GetNextTransmissionDelay (void)
 
   //    Check duty cycle    //
 
-  // Pick a random channel to transmit on
-  std::vector<Ptr<LogicalLoraChannel> > logicalChannels;
-  logicalChannels = m_channelHelper.GetEnabledChannelList ();                 // Use a separate list to do the shuffle
-  //logicalChannels = Shuffle (logicalChannels);
-
+  // Wait for the first enabled channel whose SubBand allows to transmit
+  Time waitingTime = m_channelHelper.GetMinWaitingTime ();
 
-  Time waitingTime = Time::Max ();
-
-  // Try every channel
-  std::vector<Ptr<LogicalLoraChannel> >::iterator it;
-  for (it = logicalChannels.begin (); it != logicalChannels.end (); ++it)
-    {
-      // Pointer to the current channel
-      Ptr<LogicalLoraChannel> logicalChannel = *it;
-      double frequency = logicalChannel->GetFrequency ();
-
-      waitingTime = std::min (waitingTime, m_channelHelper.GetWaitingTime (logicalChannel));
-
-      NS_LOG_DEBUG ("Waiting time before the next transmission in channel with frequecy " <<
-                    frequency << " is = " << waitingTime.GetSeconds () << ".");
-    }
+  NS_LOG_DEBUG ("Waiting time before the next transmission is = " <<
+                waitingTime.GetSeconds () << ".");
 
   waitingTime = GetNextClassTransmissionDelay (waitingTime);
 
@@ -561,58 +549,37 @@ EndDeviceLorawanMac::GetChannelForTx (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
-  // Pick a random channel to transmit on
-  std::vector<Ptr<LogicalLoraChannel> > logicalChannels;
-  logicalChannels = m_channelHelper.GetEnabledChannelList ();                 // Use a separate list to do the shuffle
-  logicalChannels = Shuffle (logicalChannels);
+  // Get the channels we can transmit on right now
+  uint32_t count = m_channelHelper.GetAvailableChannels (m_availableChannels);
 
-  // Try every channel
-  std::vector<Ptr<LogicalLoraChannel> >::iterator it;
-  for (it = logicalChannels.begin (); it != logicalChannels.end (); ++it)
+  if (count == 0)
     {
-      // Pointer to the current channel
-      Ptr<LogicalLoraChannel> logicalChannel = *it;
-      double frequency = logicalChannel->GetFrequency ();
-
-      NS_LOG_DEBUG ("Frequency of the current channel: " << frequency);
-
-      // Verify that we can send the packet
-      Time waitingTime = m_channelHelper.GetWaitingTime (logicalChannel);
-
-      NS_LOG_DEBUG ("Waiting time for current channel = " <<
-                    waitingTime.GetSeconds ());
-
-      // Send immediately if we can
-      if (waitingTime == Seconds (0))
-        {
-          return *it;
-        }
-      else
-        {
-          NS_LOG_DEBUG ("Packet cannot be immediately transmitted on " <<
-                        "the current channel because of duty cycle limitations.");
-        }
+      NS_LOG_DEBUG ("Packet cannot be immediately transmitted on any " <<
+                    "channel because of duty cycle limitations.");
+      return 0;                 // In this case, no suitable channel was found
     }
-  return 0;                 // In this case, no suitable channel was found
-}
 
-
-std::vector<Ptr<LogicalLoraChannel> >
-EndDeviceLorawanMac::Shuffle (std::vector<Ptr<LogicalLoraChannel> > vector)
-{
-  NS_LOG_FUNCTION_NOARGS ();
-
-  int size = vector.size ();
-
-  for (int i = 0; i < size; ++i)
+  // Pick a random channel among the available ones, by skipping the first
+  // set bits of the mask: first whole words, then single bits
+  uint32_t skip = m_uniformRV->GetInteger (0, count - 1);
+  uint32_t w = 0;
+  while (skip >= uint32_t (__builtin_popcountll (m_availableChannels[w])))
+    {
+      skip -= __builtin_popcountll (m_availableChannels[w]);
+      w++;
+    }
+  uint64_t available = m_availableChannels[w];
+  for (uint32_t i = 0; i < skip; i++)
     {
-      uint16_t random = std::floor (m_uniformRV->GetValue (0, size));
-      Ptr<LogicalLoraChannel> temp = vector.at (random);
-      vector.at (random) = vector.at (i);
-      vector.at (i) = temp;
+      available &= available - 1;
     }
 
-  return vector;
+  Ptr<LogicalLoraChannel> logicalChannel =
+    m_channelHelper.GetChannel (w * 64 + __builtin_ctzll (available));
+
+  NS_LOG_DEBUG ("Frequency of the chosen channel: " << logicalChannel->GetFrequency ());
+
+  return logicalChannel;
 }
 
 /////////////////////////
@@ -786,16 +753,16 @@ EndDeviceLorawanMac::OnLinkAdrReq (uint8_t dataRate, uint8_t txPower,
   if (channelMaskOk && dataRateOk && txPowerOk)
     {
       // Cycle over all channels in the list
-      for (uint32_t i = 0; i < m_channelHelper.GetChannelList ().size (); i++)
+      for (int i = 0; i < channelListSize; i++)
         {
           if (std::find (enabledChannels.begin (), enabledChannels.end (), i) != enabledChannels.end ())
             {
-              m_channelHelper.GetChannelList ().at (i)->SetEnabledForUplink ();
+              m_channelHelper.EnableChannel (i);
               NS_LOG_DEBUG ("Channel " << i << " enabled");
             }
           else
             {
-              m_channelHelper.GetChannelList ().at (i)->DisableForUplink ();
+              m_channelHelper.DisableChannel (i);
               NS_LOG_DEBUG ("Channel " << i << " disabled");
             }
         }
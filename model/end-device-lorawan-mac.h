@@ -386,12 +386,24 @@ protected:
   virtual Time GetNextClassTransmissionDelay (Time waitingTime);
 
   /**
-   * Find a suitable channel for transmission. The channel is chosen among the
-   * ones that are available in the ED's LogicalLoraChannel, based on their duty
-   * cycle limitations.
+   * Find a suitable channel for transmission. The channel is chosen at random
+   * among the ones that are available in the ED's LogicalLoraChannel, based on
+   * their duty cycle limitations.
    */
   Ptr<LogicalLoraChannel> GetChannelForTx (void);
 
+  /**
+   * The channel that was picked by Send for the transmission in progress, if
+   * any. It is only set while DoSend is running.
+   */
+  Ptr<LogicalLoraChannel> m_txChannel;
+
+  /**
+   * The channels that GetChannelForTx found to be available, kept between
+   * calls so that its storage is reused.
+   */
+  std::vector<uint64_t> m_availableChannels;
+
   /**
    * The duration of a receive window in number of symbols. This should be
    * converted to time based or the reception parameter used.
@@ -415,8 +427,8 @@ protected:
   struct LoraRetxParameters m_retxParams;
 
   /**
-   * An uniform random variable, used by the Shuffle method to randomly reorder
-   * the channel list.
+   * An uniform random variable, used to pick a random channel for
+   * transmission.
    */
   Ptr<UniformRandomVariable> m_uniformRV;
 
@@ -432,13 +444,6 @@ protected:
   TracedCallback<uint8_t, bool, Time, Ptr<Packet> > m_requiredTxCallback;
 
 private:
-  /**
-   * Randomly shuffle a Ptr<LogicalLoraChannel> vector.
-   *
-   * Used to pick a random channel on which to send the packet.
-   */
-  std::vector<Ptr<LogicalLoraChannel> > Shuffle (std::vector<Ptr<LogicalLoraChannel> > vector);
-
   /**
    * Find the minimum waiting time before the next possible transmission.
    */
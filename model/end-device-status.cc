@@ -29,6 +29,7 @@
 #include "ns3/simulator.h"
 #include "ns3/packet.h"
 #include "ns3/lora-tag.h"
+#include "ns3/uinteger.h"
 
 #include <algorithm>
 
@@ -43,7 +44,14 @@ EndDeviceStatus::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::EndDeviceStatus")
                           .SetParent<Object> ()
                           .AddConstructor<EndDeviceStatus> ()
-                          .SetGroupName ("lorawan");
+                          .SetGroupName ("lorawan")
+                          .AddAttribute ("MaxReceivedPackets",
+                                         "The number of received packets to keep "
+                                         "information about.",
+                                         UintegerValue (100),
+                                         MakeUintegerAccessor
+                                           (&EndDeviceStatus::m_maxReceivedPackets),
+                                         MakeUintegerChecker<uint32_t> (1));
   return tid;
 }
 
@@ -51,19 +59,21 @@ EndDeviceStatus::EndDeviceStatus (LoraDeviceAddress endDeviceAddress,
                                   Ptr<ClassAEndDeviceLorawanMac> endDeviceMac)
     : m_reply (EndDeviceStatus::Reply ()),
       m_endDeviceAddress (endDeviceAddress),
-      m_receivedPacketList (ReceivedPacketList ()),
+      m_oldestReceivedPacket (0),
+      m_maxReceivedPackets (100),
       m_mac (endDeviceMac)
 {
   NS_LOG_FUNCTION (endDeviceAddress);
 }
 
 EndDeviceStatus::EndDeviceStatus ()
+    : m_oldestReceivedPacket (0),
+      m_maxReceivedPackets (100)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
   // Initialize data structure
   m_reply = EndDeviceStatus::Reply ();
-  m_receivedPacketList = ReceivedPacketList ();
 }
 
 EndDeviceStatus::~EndDeviceStatus ()
@@ -126,13 +136,7 @@ EndDeviceStatus::GetCompleteReplyPacket (void)
 
   // Add headers
   m_reply.frameHeader.SetAddress (m_endDeviceAddress);
-  Ptr<Packet> lastPacket = GetLastPacketReceivedFromDevice ()->Copy ();
-  LorawanMacHeader mHdr;
-  LoraFrameHeader fHdr;
-  fHdr.SetAsUplink ();
-  lastPacket->RemoveHeader (mHdr);
-  lastPacket->RemoveHeader (fHdr);
-  m_reply.frameHeader.SetFCnt (fHdr.GetFCnt ());
+  m_reply.frameHeader.SetFCnt (GetLastUplinkReceivedFromDevice ()->GetFCnt ());
   m_reply.macHeader.SetMType (LorawanMacHeader::UNCONFIRMED_DATA_DOWN);
   replyPacket->AddHeader (m_reply.frameHeader);
   replyPacket->AddHeader (m_reply.macHeader);
@@ -182,7 +186,44 @@ EndDeviceStatus::ReceivedPacketList
 EndDeviceStatus::GetReceivedPacketList ()
 {
   NS_LOG_FUNCTION_NOARGS ();
-  return m_receivedPacketList;
+
+  // Go through the ring buffer starting from the oldest packet
+  ReceivedPacketList list;
+  uint32_t size = m_receivedPackets.size ();
+  for (uint32_t i = 0; i < size; i++)
+    {
+      const ReceivedPacketInfo &info = m_receivedPackets[(m_oldestReceivedPacket + i) % size];
+      list.push_back (std::make_pair (info.packet, info));
+    }
+  return list;
+}
+
+uint32_t
+EndDeviceStatus::GetReceivedPacketCount (void) const
+{
+  return m_receivedPackets.size ();
+}
+
+uint32_t
+EndDeviceStatus::GetMaxReceivedPackets (void) const
+{
+  return m_maxReceivedPackets;
+}
+
+const EndDeviceStatus::ReceivedPacketInfo &
+EndDeviceStatus::GetReceivedPacketInfo (uint32_t age) const
+{
+  NS_ASSERT (age < m_receivedPackets.size ());
+
+  uint32_t size = m_receivedPackets.size ();
+  return m_receivedPackets[(m_oldestReceivedPacket + size - 1 - age) % size];
+}
+
+uint32_t
+EndDeviceStatus::GetLastReceivedPacketSlot (void) const
+{
+  uint32_t size = m_receivedPackets.size ();
+  return (m_oldestReceivedPacket + size - 1) % size;
 }
 
 void
@@ -243,80 +284,122 @@ EndDeviceStatus::InsertReceivedPacket (Ptr<Packet const> receivedPacket, const A
 {
   NS_LOG_FUNCTION_NOARGS ();
 
-  // Create a copy of the packet
-  Ptr<Packet> myPacket = receivedPacket->Copy ();
+  Ptr<const DecodedUplink> uplink = Create<DecodedUplink> (receivedPacket);
+  InsertReceivedPacket (uplink, gwAddress);
+}
+
+void
+EndDeviceStatus::InsertReceivedPacket (Ptr<const DecodedUplink> uplink, const Address &gwAddress)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+
+  InsertReceivedPacket (uplink, gwAddress, UNKNOWN_GATEWAY);
+}
 
-  // Extract the headers
-  LorawanMacHeader macHdr;
-  myPacket->RemoveHeader (macHdr);
+void
+EndDeviceStatus::InsertReceivedPacket (Ptr<const DecodedUplink> uplink, const Address &gwAddress,
+                                       uint32_t gwIndex)
+{
+  NS_LOG_FUNCTION_NOARGS ();
 
-  LoraFrameHeader frameHdr;
-  frameHdr.SetAsUplink ();
-  myPacket->RemoveHeader (frameHdr);
+  Ptr<Packet const> receivedPacket = uplink->GetPacket ();
 
   // Update current parameters
-  LoraTag tag;
-  myPacket->RemovePacketTag (tag);
+  LoraTag tag = uplink->GetTag ();
   SetFirstReceiveWindowSpreadingFactor (tag.GetSpreadingFactor ());
   SetFirstReceiveWindowFrequency (tag.GetFrequency ());
 
-  // Update Information on the received packet
-  ReceivedPacketInfo info;
-  info.sf = tag.GetSpreadingFactor ();
-  info.frequency = tag.GetFrequency ();
-  info.packet = receivedPacket;
-
   double rcvPower = tag.GetReceivePower ();
 
-  // Perform insertion in list, also checking that the packet isn't already in
-  // the list (it could have been received by another GW already)
+  PacketInfoPerGw gwInfo;
+  gwInfo.receivedTime = Simulator::Now ();
+  gwInfo.rxPower = rcvPower;
+  gwInfo.gwAddress = gwAddress;
 
-  // Start searching from the end
-  auto it = m_receivedPacketList.rbegin ();
-  for (; it != m_receivedPacketList.rend (); it++)
-    {
-      // Get the frame counter of the current packet to compare it with the
-      // newly received one
-      Ptr<Packet> packetCopy = ((*it).first)->Copy ();
-      LorawanMacHeader currentMacHdr;
-      packetCopy->RemoveHeader (currentMacHdr);
-      LoraFrameHeader currentFrameHdr;
-      frameHdr.SetAsUplink ();
-      packetCopy->RemoveHeader (currentFrameHdr);
-
-      NS_LOG_DEBUG ("Received packet's frame counter: " << unsigned(frameHdr.GetFCnt ())
-                                                        << "\nCurrent packet's frame counter: "
-                                                        << unsigned(currentFrameHdr.GetFCnt ()));
-
-      if (frameHdr.GetFCnt () == currentFrameHdr.GetFCnt ())
-        {
-          NS_LOG_INFO ("Packet was already received by another gateway");
+  // Check whether the packet is already in the list (it could have been
+  // received by another GW already) by looking for its frame counter
+  std::unordered_map<uint16_t, uint32_t>::iterator it =
+    m_receivedPacketSlots.find (uplink->GetFCnt ());
 
-          // This packet had already been received from another gateway:
-          // add this gateway's reception information.
-          GatewayList &gwList = it->second.gwList;
-
-          PacketInfoPerGw gwInfo;
-          gwInfo.receivedTime = Simulator::Now ();
-          gwInfo.rxPower = rcvPower;
-          gwInfo.gwAddress = gwAddress;
-          gwList.insert (std::pair<Address, PacketInfoPerGw> (gwAddress, gwInfo));
-
-          NS_LOG_DEBUG ("Size of gateway list: " << gwList.size ());
+  if (it != m_receivedPacketSlots.end ())
+    {
+      NS_LOG_INFO ("Packet was already received by another gateway");
 
-          break; // Exit from the cycle
+      // This packet had already been received from another gateway:
+      // add this gateway's reception information.
+      ReceivedPacketInfo &info = m_receivedPackets[it->second];
+      if (info.gwList.insert (std::pair<Address, PacketInfoPerGw> (gwAddress, gwInfo)).second)
+        {
+          // Update the combined reception power
+          info.rxPowerSum += rcvPower;
+          info.maxRxPower = std::max (info.maxRxPower, rcvPower);
+          info.minRxPower = std::min (info.minRxPower, rcvPower);
+
+          if (it->second == GetLastReceivedPacketSlot ())
+            {
+              AddToGatewayRanking (gwAddress, gwIndex, rcvPower);
+            }
         }
+
+      NS_LOG_DEBUG ("Size of gateway list: " << info.gwList.size ());
     }
-  if (it == m_receivedPacketList.rend ())
+  else
     {
       NS_LOG_INFO ("Packet was received for the first time");
-      PacketInfoPerGw gwInfo;
-      gwInfo.receivedTime = Simulator::Now ();
-      gwInfo.rxPower = rcvPower;
-      gwInfo.gwAddress = gwAddress;
+
+      // Update Information on the received packet
+      ReceivedPacketInfo info;
+      info.sf = tag.GetSpreadingFactor ();
+      info.frequency = tag.GetFrequency ();
+      info.fCnt = uplink->GetFCnt ();
+      info.packet = receivedPacket;
+      info.uplink = uplink;
       info.gwList.insert (std::pair<Address, PacketInfoPerGw> (gwAddress, gwInfo));
-      m_receivedPacketList.push_back (
-          std::pair<Ptr<Packet const>, ReceivedPacketInfo> (receivedPacket, info));
+      info.rxPowerSum = rcvPower;
+      info.maxRxPower = rcvPower;
+      info.minRxPower = rcvPower;
+
+      uint32_t slot = m_receivedPackets.size ();
+      if (slot > 0)
+        {
+          // The previous packet is not the last one anymore: we only need its
+          // decoded information
+          ReceivedPacketInfo &last = m_receivedPackets[GetLastReceivedPacketSlot ()];
+          last.packet = 0;
+          last.uplink = 0;
+        }
+
+      if (slot < m_maxReceivedPackets)
+        {
+          if (m_oldestReceivedPacket != 0)
+            {
+              // MaxReceivedPackets was raised after the buffer wrapped around:
+              // put the oldest packet first again, so that the new one can be
+              // appended after the last one
+              std::rotate (m_receivedPackets.begin (),
+                           m_receivedPackets.begin () + m_oldestReceivedPacket,
+                           m_receivedPackets.end ());
+              m_oldestReceivedPacket = 0;
+              for (uint32_t i = 0; i < m_receivedPackets.size (); i++)
+                {
+                  m_receivedPacketSlots[m_receivedPackets[i].fCnt] = i;
+                }
+            }
+          m_receivedPackets.push_back (info);
+        }
+      else
+        {
+          // Replace the oldest packet
+          slot = m_oldestReceivedPacket;
+          m_receivedPacketSlots.erase (m_receivedPackets[slot].fCnt);
+          m_receivedPackets[slot] = info;
+          m_oldestReceivedPacket = (m_oldestReceivedPacket + 1) % m_receivedPackets.size ();
+        }
+      m_receivedPacketSlots[info.fCnt] = slot;
+
+      // The ranking only refers to the last packet
+      m_gatewayRanking.clear ();
+      AddToGatewayRanking (gwAddress, gwIndex, rcvPower);
     }
   NS_LOG_DEBUG (*this);
 }
@@ -325,10 +408,9 @@ EndDeviceStatus::ReceivedPacketInfo
 EndDeviceStatus::GetLastReceivedPacketInfo (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
-  auto it = m_receivedPacketList.rbegin ();
-  if (it != m_receivedPacketList.rend ())
+  if (!m_receivedPackets.empty ())
     {
-      return it->second;
+      return m_receivedPackets[GetLastReceivedPacketSlot ()];
     }
   else
     {
@@ -340,10 +422,23 @@ Ptr<Packet const>
 EndDeviceStatus::GetLastPacketReceivedFromDevice (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
-  auto it = m_receivedPacketList.rbegin ();
-  if (it != m_receivedPacketList.rend ())
+  if (!m_receivedPackets.empty ())
     {
-      return it->first;
+      return m_receivedPackets[GetLastReceivedPacketSlot ()].packet;
+    }
+  else
+    {
+      return 0;
+    }
+}
+
+Ptr<const DecodedUplink>
+EndDeviceStatus::GetLastUplinkReceivedFromDevice (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  if (!m_receivedPackets.empty ())
+    {
+      return m_receivedPackets[GetLastReceivedPacketSlot ()].uplink;
     }
   else
     {
@@ -368,7 +463,7 @@ EndDeviceStatus::AddMACCommand (Ptr<MacCommand> macCommand)
 bool
 EndDeviceStatus::HasReceiveWindowOpportunityScheduled ()
 {
-  return m_receiveWindowEvent.IsRunning();
+  return m_receiveWindowEvent.IsRunning() || m_receiveWindowQueued;
 }
 
 void
@@ -381,6 +476,25 @@ void
 EndDeviceStatus::RemoveReceiveWindowOpportunity (void)
 {
   Simulator::Cancel(m_receiveWindowEvent);
+  m_receiveWindowQueued = false;
+}
+
+uint32_t
+EndDeviceStatus::QueueReceiveWindowOpportunity (void)
+{
+  m_receiveWindowQueued = true;
+  return ++m_receiveWindowTicket;
+}
+
+bool
+EndDeviceStatus::FireReceiveWindowOpportunity (uint32_t ticket)
+{
+  if (!m_receiveWindowQueued || ticket != m_receiveWindowTicket)
+    {
+      return false;
+    }
+  m_receiveWindowQueued = false;
+  return true;
 }
 
 std::map<double, Address>
@@ -389,34 +503,54 @@ EndDeviceStatus::GetPowerGatewayMap (void)
   // Create a map of the gateways
   // Key: received power
   // Value: address of the corresponding gateway
-  ReceivedPacketInfo info = m_receivedPacketList.back ().second;
-  GatewayList gwList = info.gwList;
-
   std::map<double, Address> gatewayPowers;
 
-  for (auto it = gwList.begin (); it != gwList.end (); it++)
+  for (auto it = m_gatewayRanking.begin (); it != m_gatewayRanking.end (); it++)
     {
-      Address currentGwAddress = (*it).first;
-      double currentRxPower = (*it).second.rxPower;
-      gatewayPowers.insert (std::pair<double, Address> (currentRxPower, currentGwAddress));
+      gatewayPowers.insert (std::pair<double, Address> (it->rxPower, it->gwAddress));
     }
 
   return gatewayPowers;
 }
 
+const EndDeviceStatus::GatewayRanking &
+EndDeviceStatus::GetGatewayRanking (void) const
+{
+  return m_gatewayRanking;
+}
+
+void
+EndDeviceStatus::AddToGatewayRanking (const Address &gwAddress, uint32_t gwIndex,
+                                      double rxPower)
+{
+  GatewayRank rank;
+  rank.gwAddress = gwAddress;
+  rank.gwIndex = gwIndex;
+  rank.rxPower = rxPower;
+
+  // Gateways with the same power stay in the order they received the packet
+  GatewayRanking::iterator it = m_gatewayRanking.begin ();
+  while (it != m_gatewayRanking.end () && it->rxPower >= rxPower)
+    {
+      it++;
+    }
+  m_gatewayRanking.insert (it, rank);
+}
+
 std::ostream &
 operator<< (std::ostream &os, const EndDeviceStatus &status)
 {
-  os << "Total packets received: " << status.m_receivedPacketList.size () << std::endl;
+  uint32_t size = status.m_receivedPackets.size ();
+  os << "Total packets received: " << size << std::endl;
 
-  for (auto j = status.m_receivedPacketList.begin (); j != status.m_receivedPacketList.end (); j++)
+  for (uint32_t j = 0; j < size; j++)
     {
-      EndDeviceStatus::ReceivedPacketInfo info = (*j).second;
-      EndDeviceStatus::GatewayList gatewayList = info.gwList;
-      Ptr<Packet const> pkt = (*j).first;
-      os << pkt << " " << gatewayList.size () << std::endl;
-      for (EndDeviceStatus::GatewayList::iterator k = gatewayList.begin (); k != gatewayList.end ();
-           k++)
+      const EndDeviceStatus::ReceivedPacketInfo &info =
+        status.m_receivedPackets[(status.m_oldestReceivedPacket + j) % size];
+      const EndDeviceStatus::GatewayList &gatewayList = info.gwList;
+      os << unsigned (info.fCnt) << " " << gatewayList.size () << std::endl;
+      for (EndDeviceStatus::GatewayList::const_iterator k = gatewayList.begin ();
+           k != gatewayList.end (); k++)
         {
           EndDeviceStatus::PacketInfoPerGw infoPerGw = (*k).second;
           os << "  " << infoPerGw.gwAddress << " " << infoPerGw.rxPower << std::endl;
@@ -27,9 +27,12 @@
 #include "ns3/lorawan-mac-header.h"
 #include "ns3/class-a-end-device-lorawan-mac.h"
 #include "ns3/lora-frame-header.h"
+#include "ns3/decoded-uplink.h"
 #include "ns3/pointer.h"
 #include "ns3/lora-frame-header.h"
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
@@ -47,6 +50,10 @@ namespace lorawan {
  * called to update the information regarding the last received packet and its
  * parameters.
  *
+ * Only the information about the last MaxReceivedPackets packets is kept, in a
+ * ring buffer indexed by frame counter. The received packet itself is only
+ * kept for the last packet, since the decoded headers are all that is needed
+ * for the older ones.
  */
 
 /*
@@ -167,15 +174,38 @@ public:
   struct ReceivedPacketInfo
   {
     // Members
-    Ptr<Packet const> packet = 0;   //!< The received packet
+    Ptr<Packet const> packet = 0;   //!< The received packet, if it's the last one
+    Ptr<const DecodedUplink> uplink = 0;   //!< The headers of the received packet, if it's the last one
     GatewayList gwList;      //!< List of gateways that received this packet.
     uint8_t sf;
     double frequency;
+    uint16_t fCnt = 0;      //!< The frame counter of the packet
+    double rxPowerSum = 0;      //!< Sum of the reception powers at the gateways in gwList
+    double maxRxPower = 0;      //!< Maximum reception power among the gateways in gwList
+    double minRxPower = 0;      //!< Minimum reception power among the gateways in gwList
   };
 
   typedef std::list<std::pair<Ptr<Packet const>, ReceivedPacketInfo> >
     ReceivedPacketList;
 
+  /**
+   * A gateway that received the last packet of the device.
+   */
+  struct GatewayRank
+  {
+    Address gwAddress;     //!< Address of the gateway
+    uint32_t gwIndex;      //!< Index of the gateway in the NetworkStatus, or UNKNOWN_GATEWAY
+    double rxPower;        //!< Reception power of the last packet at this gateway
+  };
+
+  /**
+   * The gateways that received the last packet, from the one with the
+   * highest reception power to the one with the lowest.
+   */
+  typedef std::vector<GatewayRank> GatewayRanking;
+
+  static const uint32_t UNKNOWN_GATEWAY = 0xffffffff;   //!< Index of unregistered gateways
+
 
   /*******************************************/
   /* Proper EndDeviceStatus class definition */
@@ -215,12 +245,38 @@ public:
   double GetSecondReceiveWindowFrequency (void);
 
   /**
-   * Get the received packet list.
+   * Get the received packet list, from the oldest to the last packet.
+   *
+   * Only the last packet of the list has its packet and uplink fields set.
    *
    * \return The received packet list.
    */
   ReceivedPacketList GetReceivedPacketList (void);
 
+  /**
+   * Get the number of received packets whose information is kept.
+   *
+   * \return The number of packets.
+   */
+  uint32_t GetReceivedPacketCount (void) const;
+
+  /**
+   * Get the maximum number of received packets whose information is kept.
+   *
+   * \return The value of the MaxReceivedPackets attribute.
+   */
+  uint32_t GetMaxReceivedPackets (void) const;
+
+  /**
+   * Get the information about a received packet, without copying it.
+   *
+   * \param age The position of the packet, starting from the last one: 0 is
+   * the last packet, 1 the one before it, and so on. It must be lower than
+   * GetReceivedPacketCount.
+   * \return The information about the packet.
+   */
+  const ReceivedPacketInfo &GetReceivedPacketInfo (uint32_t age) const;
+
   /**
    * Set the spreading factor this device is using in the first receive window.
    */
@@ -268,11 +324,36 @@ public:
   void InsertReceivedPacket (Ptr<Packet const> receivedPacket,
                              const Address& gwAddress);
 
+  /**
+   * Insert a received packet, whose headers were already decoded, in the
+   * packet list.
+   */
+  void InsertReceivedPacket (Ptr<const DecodedUplink> uplink,
+                             const Address& gwAddress);
+
+  /**
+   * Insert a received packet, whose headers were already decoded, in the
+   * packet list.
+   *
+   * \param uplink The received packet.
+   * \param gwAddress The address of the gateway that received the packet.
+   * \param gwIndex The index of the gateway in the NetworkStatus, which is
+   * kept in the gateway ranking.
+   */
+  void InsertReceivedPacket (Ptr<const DecodedUplink> uplink,
+                             const Address& gwAddress, uint32_t gwIndex);
+
   /**
    * Return the last packet that was received from this device.
    */
   Ptr<Packet const> GetLastPacketReceivedFromDevice (void);
 
+  /**
+   * Return the decoded headers of the last packet that was received from
+   * this device.
+   */
+  Ptr<const DecodedUplink> GetLastUplinkReceivedFromDevice (void);
+
   /**
    * Return the information about the last packet that was received from the
    * device.
@@ -303,11 +384,43 @@ public:
 
   void RemoveReceiveWindowOpportunity (void);
 
+  /**
+   * Mark a receive window opportunity as queued in the NetworkScheduler,
+   * which fires it without a dedicated simulator event.
+   *
+   * \return A ticket that identifies the opportunity.
+   */
+  uint32_t QueueReceiveWindowOpportunity (void);
+
+  /**
+   * Mark a queued receive window opportunity as happening.
+   *
+   * \param ticket The ticket returned when the opportunity was queued.
+   * \return Whether the opportunity is still due, i.e., it was neither
+   * removed nor replaced by another one since it was queued.
+   */
+  bool FireReceiveWindowOpportunity (uint32_t ticket);
+
   /**
    * Return an ordered list of the best gateways.
+   *
+   * Gateways that received the last packet with the same power share a key,
+   * so only one of them is returned: use GetGatewayRanking to get all of
+   * them.
    */
   std::map<double, Address> GetPowerGatewayMap (void);
 
+  /**
+   * Get the gateways that received the last packet, from the best to the
+   * worst.
+   *
+   * The ranking is updated as receptions are inserted, so this doesn't
+   * allocate or sort anything.
+   *
+   * \return The gateway ranking.
+   */
+  const GatewayRanking &GetGatewayRanking (void) const;
+
   struct Reply m_reply; //<! Next reply intended for this device
 
   LoraDeviceAddress m_endDeviceAddress;   //<! The address of this device
@@ -321,8 +434,39 @@ private:
   uint8_t m_secondReceiveWindowOffset = 0;
   double m_secondReceiveWindowFrequency = 869.525;
   EventId m_receiveWindowEvent;
+  bool m_receiveWindowQueued = false;   //!< Whether an opportunity is queued
+  uint32_t m_receiveWindowTicket = 0;   //!< The ticket of the last queued opportunity
+
+  /**
+   * Get the position of the last received packet in m_receivedPackets.
+   */
+  uint32_t GetLastReceivedPacketSlot (void) const;
 
-  ReceivedPacketList m_receivedPacketList;   //<! List of received packets
+  /**
+   * Insert a gateway that received the last packet in the ranking.
+   */
+  void AddToGatewayRanking (const Address &gwAddress, uint32_t gwIndex,
+                            double rxPower);
+
+  /**
+   * The received packets. Once MaxReceivedPackets packets are stored, this is
+   * used as a ring buffer, and new packets replace the oldest one.
+   */
+  std::vector<ReceivedPacketInfo> m_receivedPackets;
+  uint32_t m_oldestReceivedPacket;   //!< The position of the oldest packet
+  uint32_t m_maxReceivedPackets;   //!< The number of packets to keep
+
+  /**
+   * The position of each packet in m_receivedPackets, by frame counter.
+   */
+  std::unordered_map<uint16_t, uint32_t> m_receivedPacketSlots;
+
+  /**
+   * The gateways that received the last packet. The vector is reused from
+   * one packet to the next, so it only allocates when more gateways than
+   * ever before receive a packet.
+   */
+  GatewayRanking m_gatewayRanking;
 
   // NOTE Using this attribute is 'cheating', since we are assuming perfect
   // synchronization between the info at the device and at the network server
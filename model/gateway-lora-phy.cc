@@ -139,7 +139,29 @@ GatewayLoraPhy::AddReceptionPath ()
 {
   NS_LOG_FUNCTION_NOARGS ();
 
+  // Paths that can receive on any frequency are stored under frequency 0
+  AddReceptionPath (0);
+}
+
+void
+GatewayLoraPhy::AddReceptionPath (double frequencyMHz)
+{
+  NS_LOG_FUNCTION (this << frequencyMHz);
+
+  uint32_t index = m_receptionPaths.size ();
   m_receptionPaths.push_back (Create<GatewayLoraPhy::ReceptionPath> ());
+
+  // Make room in the bitmaps
+  uint32_t words = index / 64 + 1;
+  m_occupiedPaths.resize (words, 0);
+  for (auto &frequency : m_pathsPerFrequency)
+    {
+      frequency.second.resize (words, 0);
+    }
+
+  std::vector<uint64_t> &paths = m_pathsPerFrequency[frequencyMHz];
+  paths.resize (words, 0);
+  paths[index / 64] |= uint64_t (1) << (index % 64);
 }
 
 void
@@ -148,6 +170,77 @@ GatewayLoraPhy::ResetReceptionPaths (void)
   NS_LOG_FUNCTION (this);
 
   m_receptionPaths.clear ();
+  m_occupiedPaths.clear ();
+  m_pathsPerFrequency.clear ();
+  m_eventPaths.clear ();
+}
+
+int32_t
+GatewayLoraPhy::GetFreeReceptionPath (double frequencyMHz) const
+{
+  NS_LOG_FUNCTION (this << frequencyMHz);
+
+  // Try the paths dedicated to this frequency first, then the ones that can
+  // receive on any frequency
+  double frequencies[2] = {frequencyMHz, 0};
+  for (uint32_t f = 0; f < (frequencyMHz == 0 ? 1 : 2); f++)
+    {
+      std::map<double, std::vector<uint64_t>>::const_iterator it =
+          m_pathsPerFrequency.find (frequencies[f]);
+      if (it == m_pathsPerFrequency.end ())
+        {
+          continue;
+        }
+
+      for (uint32_t w = 0; w < it->second.size (); w++)
+        {
+          uint64_t free = it->second[w] & ~m_occupiedPaths[w];
+          if (free != 0)
+            {
+              // Pick the free path with the lowest index
+              return 64 * w + __builtin_ctzll (free);
+            }
+        }
+    }
+
+  return -1;
+}
+
+Ptr<GatewayLoraPhy::ReceptionPath>
+GatewayLoraPhy::LockReceptionPath (uint32_t index, Ptr<LoraInterferenceHelper::Event> event)
+{
+  NS_LOG_FUNCTION (this << index << event);
+
+  NS_ASSERT (!(m_occupiedPaths[index / 64] & uint64_t (1) << (index % 64)));
+
+  Ptr<ReceptionPath> path = m_receptionPaths[index];
+  path->LockOnEvent (event);
+  m_occupiedPaths[index / 64] |= uint64_t (1) << (index % 64);
+  m_eventPaths[PeekPointer (event)] = index;
+  m_occupiedReceptionPaths++;
+
+  return path;
+}
+
+bool
+GatewayLoraPhy::FreeReceptionPath (Ptr<LoraInterferenceHelper::Event> event)
+{
+  NS_LOG_FUNCTION (this << event);
+
+  std::unordered_map<const LoraInterferenceHelper::Event *, uint32_t>::iterator it =
+      m_eventPaths.find (PeekPointer (event));
+  if (it == m_eventPaths.end ())
+    {
+      return false;
+    }
+
+  uint32_t index = it->second;
+  m_eventPaths.erase (it);
+  m_receptionPaths[index]->Free ();
+  m_occupiedPaths[index / 64] &= ~(uint64_t (1) << (index % 64));
+  m_occupiedReceptionPaths--;
+
+  return true;
 }
 
 void
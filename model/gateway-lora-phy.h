@@ -29,6 +29,9 @@
 #include "ns3/lora-phy.h"
 #include "ns3/traced-value.h"
 #include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
@@ -44,6 +47,12 @@ class LoraChannel;
  * simultaneously. This characteristic of the chip is modeled using the
  * ReceivePath class, which describes a single parallel receiver. GatewayLoraPhy
  * essentially holds and manages a collection of these objects.
+ *
+ * Reception paths are kept in a pool that tracks which of them are free with
+ * a bitmap, so that finding a free path, locking it and releasing it do not
+ * depend on the number of paths. This allows to model gateways with many
+ * more than 8 reception paths. Paths can either receive packets on any
+ * frequency, or be dedicated to a single frequency.
  */
 class GatewayLoraPhy : public LoraPhy
 {
@@ -54,9 +63,10 @@ public:
   virtual ~GatewayLoraPhy ();
 
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm, uint8_t sf, Time duration,
-                             double frequencyMHz) = 0;
+                             double frequencyMHz, Ptr<LoraInterferenceHelper::Event> event) = 0;
 
-  virtual void EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event) = 0;
+  virtual void EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event,
+                           double rxPowerDbm) = 0;
 
   virtual void Send (Ptr<Packet> packet, LoraTxParameters txParams, double frequencyMHz,
                      double txPowerDbm) = 0;
@@ -68,10 +78,20 @@ public:
   virtual bool IsOnFrequency (double frequencyMHz);
 
   /**
-   * Add a reception path, locked on a specific frequency.
+   * Add a reception path, which can receive packets on any frequency.
    */
   void AddReceptionPath ();
 
+  /**
+   * Add a reception path that only receives packets on a certain frequency.
+   *
+   * Packets on this frequency are assigned to the dedicated paths first, and
+   * then to the paths that can receive packets on any frequency.
+   *
+   * \param frequencyMHz The frequency of the reception path.
+   */
+  void AddReceptionPath (double frequencyMHz);
+
   /**
    * Reset the list of reception paths.
    *
@@ -178,10 +198,55 @@ protected:
   };
 
   /**
-   * A list containing the various parallel receivers that are managed by this
-   * Gateway.
+   * Find a free reception path that can receive a packet on a certain
+   * frequency.
+   *
+   * \param frequencyMHz The frequency of the packet.
+   * \return The index of the reception path, or -1 if all the paths that can
+   * receive on that frequency are occupied.
+   */
+  int32_t GetFreeReceptionPath (double frequencyMHz) const;
+
+  /**
+   * Lock a free reception path on an event.
+   *
+   * \param index The index of the reception path.
+   * \param event The event to lock on.
+   * \return The reception path.
+   */
+  Ptr<ReceptionPath> LockReceptionPath (uint32_t index,
+                                        Ptr<LoraInterferenceHelper::Event> event);
+
+  /**
+   * Free the reception path that is locked on an event.
+   *
+   * \param event The event.
+   * \return Whether a reception path was locked on the event.
+   */
+  bool FreeReceptionPath (Ptr<LoraInterferenceHelper::Event> event);
+
+  /**
+   * The parallel receivers that are managed by this Gateway.
+   */
+  std::vector<Ptr<ReceptionPath>> m_receptionPaths;
+
+  /**
+   * The reception paths that are locked on an event, as a bitmap: bit i of
+   * word w is set if path 64 * w + i is occupied.
+   */
+  std::vector<uint64_t> m_occupiedPaths;
+
+  /**
+   * The reception paths that can receive packets on each frequency, as
+   * bitmaps with the same layout as m_occupiedPaths. Paths that can receive
+   * on any frequency are stored under frequency 0.
+   */
+  std::map<double, std::vector<uint64_t>> m_pathsPerFrequency;
+
+  /**
+   * The index of the reception path that is locked on each event.
    */
-  std::list<Ptr<ReceptionPath>> m_receptionPaths;
+  std::unordered_map<const LoraInterferenceHelper::Event *, uint32_t> m_eventPaths;
 
   /**
    * The number of occupied reception paths.
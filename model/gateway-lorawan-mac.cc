@@ -68,7 +68,7 @@ GatewayLorawanMac::Send (Ptr<Packet> packet)
   packet->AddPacketTag (tag);
 
   // Make sure we can transmit this packet
-  if (m_channelHelper.GetWaitingTime(CreateObject<LogicalLoraChannel> (frequency)) > Time(0))
+  if (m_channelHelper.GetWaitingTime (frequency) > Time (0))
     {
       // We cannot send now!
       NS_LOG_WARN ("Trying to send a packet but Duty Cycle won't allow it. Aborting.");
@@ -89,13 +89,11 @@ GatewayLorawanMac::Send (Ptr<Packet> packet)
 
   NS_LOG_DEBUG ("Duration: " << duration.GetSeconds ());
 
-  // Find the channel with the desired frequency
-  double sendingPower = m_channelHelper.GetTxPowerForChannel
-      (CreateObject<LogicalLoraChannel> (frequency));
+  // Get the maximum transmission power allowed on this frequency
+  double sendingPower = m_channelHelper.GetTxPowerForFrequency (frequency);
 
   // Add the event to the channelHelper to keep track of duty cycle
-  m_channelHelper.AddEvent (duration, CreateObject<LogicalLoraChannel>
-                              (frequency));
+  m_channelHelper.AddEvent (duration, frequency);
 
   // Send the packet to the PHY layer to send it on the channel
   m_phy->Send (packet, params, frequency, sendingPower);
@@ -114,15 +112,11 @@ GatewayLorawanMac::Receive (Ptr<Packet const> packet)
 {
   NS_LOG_FUNCTION (this << packet);
 
-  // Make a copy of the packet to work on
-  Ptr<Packet> packetCopy = packet->Copy ();
-
   // Only forward the packet if it's uplink
-  LorawanMacHeader macHdr;
-  packetCopy->PeekHeader (macHdr);
-
-  if (macHdr.IsUplink ())
+  if (LorawanMacHeader::Peek (packet).IsUplink ())
     {
+      // Make a copy of the packet to hand to the device
+      Ptr<Packet> packetCopy = packet->Copy ();
       m_device->GetObject<LoraNetDevice> ()->Receive (packetCopy);
 
       NS_LOG_DEBUG ("Received packet: " << packet);
@@ -152,8 +146,7 @@ GatewayLorawanMac::GetWaitingTime (double frequency)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
-  return m_channelHelper.GetWaitingTime (CreateObject<LogicalLoraChannel>
-                                           (frequency));
+  return m_channelHelper.GetWaitingTime (frequency);
 }
 }
 }
@@ -37,6 +37,7 @@ GatewayStatus::GetTypeId (void)
 
 
 GatewayStatus::GatewayStatus ()
+  : m_index (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -51,7 +52,8 @@ GatewayStatus::GatewayStatus (Address address, Ptr<NetDevice> netDevice,
   m_address (address),
   m_netDevice (netDevice),
   m_gatewayMac (gwMac),
-  m_nextTransmissionTime (Seconds (0))
+  m_nextTransmissionTime (Seconds (0)),
+  m_index (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -90,8 +92,20 @@ GatewayStatus::GetGatewayMac (void)
   return m_gatewayMac;
 }
 
+uint32_t
+GatewayStatus::GetIndex (void) const
+{
+  return m_index;
+}
+
+void
+GatewayStatus::SetIndex (uint32_t index)
+{
+  m_index = index;
+}
+
 bool
-GatewayStatus::IsAvailableForTransmission (double frequency)
+GatewayStatus::IsBusy (void)
 {
   // We can't send multiple packets at once, see SX1301 V2.01 page 29
 
@@ -99,13 +113,24 @@ GatewayStatus::IsAvailableForTransmission (double frequency)
   if (m_nextTransmissionTime > Simulator::Now () - MilliSeconds (1))
     {
       NS_LOG_INFO ("This gateway is already booked for a transmission");
-      return false;
+      return true;
     }
 
   // Check that the gateway is not already in TX mode
   if (m_gatewayMac->IsTransmitting ())
     {
       NS_LOG_INFO ("This gateway is currently transmitting");
+      return true;
+    }
+
+  return false;
+}
+
+bool
+GatewayStatus::IsAvailableForTransmission (double frequency)
+{
+  if (IsBusy ())
+    {
       return false;
     }
 
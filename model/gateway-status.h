@@ -63,6 +63,18 @@ public:
    */
   Ptr<GatewayLorawanMac> GetGatewayMac (void);
 
+  /**
+   * Get the index of this gateway among the ones registered in the
+   * NetworkStatus.
+   */
+  uint32_t GetIndex (void) const;
+
+  /**
+   * Set the index of this gateway among the ones registered in the
+   * NetworkStatus.
+   */
+  void SetIndex (uint32_t index);
+
   /**
    * Set a pointer to this gateway's MAC instance.
    */
@@ -78,6 +90,14 @@ public:
    */
   bool IsAvailableForTransmission (double frequency);
 
+  /**
+   * Query whether this gateway is already booked for a transmission or is
+   * transmitting, which makes it unavailable on all frequencies.
+   *
+   * \return True if the gateway is busy, false otherwise.
+   */
+  bool IsBusy (void);
+
   void SetNextTransmissionTime (Time nextTransmissionTime);
   // Time GetNextTransmissionTime (void);
 
@@ -89,6 +109,8 @@ private:
   Ptr<GatewayLorawanMac> m_gatewayMac;     //!< The Mac layer of the gateway
 
   Time m_nextTransmissionTime;   //!< This gateway's next transmission time
+
+  uint32_t m_index;   //!< The index of this gateway in the NetworkStatus
 };
 }
 
@@ -39,6 +39,7 @@ LogicalLoraChannelHelper::GetTypeId (void)
 }
 
 LogicalLoraChannelHelper::LogicalLoraChannelHelper () :
+  m_plan (Create<ChannelPlan> ()),
   m_nextAggregatedTransmissionTime (Seconds (0)),
   m_aggregatedDutyCycle (1)
 {
@@ -50,18 +51,44 @@ LogicalLoraChannelHelper::~LogicalLoraChannelHelper ()
   NS_LOG_FUNCTION (this);
 }
 
+Ptr<LogicalLoraChannelHelper::ChannelPlan>
+LogicalLoraChannelHelper::GetWritablePlan (void)
+{
+  // Make a private copy of the plan if other helpers are using it
+  if (m_plan->GetReferenceCount () > 1)
+    {
+      NS_LOG_DEBUG ("Copying the shared channel plan");
+      m_plan = Create<ChannelPlan> (*m_plan);
+    }
+
+  return m_plan;
+}
+
+void
+LogicalLoraChannelHelper::ChannelPlan::IndexSubBands (void)
+{
+  frequencySubBands.clear ();
+  channelSubBands.assign (channels.size (), NO_SUB_BAND);
+  for (uint32_t i = 0; i < channels.size (); i++)
+    {
+      for (uint32_t j = 0; j < subBands.size (); j++)
+        {
+          if (subBands[j]->BelongsToSubBand (channels[i]->GetFrequency ()))
+            {
+              channelSubBands[i] = j;
+              break;
+            }
+        }
+    }
+}
+
 std::vector<Ptr <LogicalLoraChannel> >
 LogicalLoraChannelHelper::GetChannelList (void)
 {
   NS_LOG_FUNCTION (this);
 
   // Make a copy of the channel vector
-  std::vector<Ptr<LogicalLoraChannel> > vector;
-  vector.reserve (m_channelList.size ());
-  std::copy (m_channelList.begin (), m_channelList.end (), std::back_inserter
-               (vector));
-
-  return vector;
+  return m_plan->channels;
 }
 
 
@@ -70,25 +97,67 @@ LogicalLoraChannelHelper::GetEnabledChannelList (void)
 {
   NS_LOG_FUNCTION (this);
 
-  // Make a copy of the channel vector
-  std::vector<Ptr<LogicalLoraChannel> > vector;
-  vector.reserve (m_channelList.size ());
-  std::copy (m_channelList.begin (), m_channelList.end (), std::back_inserter
-               (vector));     // Working on a copy
-
   std::vector<Ptr <LogicalLoraChannel> > channels;
-  std::vector<Ptr <LogicalLoraChannel> >::iterator it;
-  for (it = vector.begin (); it != vector.end (); it++)
+  for (uint32_t i = 0; i < m_plan->channels.size (); i++)
     {
-      if ((*it)->IsEnabledForUplink ())
+      if (IsChannelEnabled (i))
         {
-          channels.push_back (*it);
+          channels.push_back (m_plan->channels[i]);
         }
     }
 
   return channels;
 }
 
+uint32_t
+LogicalLoraChannelHelper::GetAvailableChannels (std::vector<uint64_t> &available) const
+{
+  NS_LOG_FUNCTION (this);
+
+  // Find the SubBands in which the duty cycle doesn't allow to transmit
+  Time now = Simulator::Now ();
+  uint64_t blockedSubBands = 0;
+  for (uint32_t i = 0; i < m_nextTransmissionTimes.size (); i++)
+    {
+      if (m_nextTransmissionTimes[i] > now)
+        {
+          blockedSubBands |= uint64_t (1) << i;
+        }
+    }
+
+  // Go through the set bits of the channel mask
+  available.assign (m_enabledChannels.begin (), m_enabledChannels.end ());
+  uint32_t count = 0;
+  for (uint32_t w = 0; w < m_enabledChannels.size (); w++)
+    {
+      for (uint64_t channels = m_enabledChannels[w]; channels != 0; channels &= channels - 1)
+        {
+          uint32_t bit = __builtin_ctzll (channels);
+          uint32_t subBand = m_plan->channelSubBands[w * 64 + bit];
+
+          NS_ABORT_MSG_IF (subBand == NO_SUB_BAND,
+                           "Warning: frequency is outside any known SubBand.");
+
+          if ((blockedSubBands >> subBand) & 1)
+            {
+              available[w] &= ~(uint64_t (1) << bit);
+            }
+          else
+            {
+              count++;
+            }
+        }
+    }
+
+  return count;
+}
+
+Ptr<LogicalLoraChannel>
+LogicalLoraChannelHelper::GetChannel (uint32_t index) const
+{
+  return m_plan->channels.at (index);
+}
+
 Ptr<SubBand>
 LogicalLoraChannelHelper::GetSubBandFromChannel (Ptr<LogicalLoraChannel>
                                                  channel)
@@ -99,20 +168,35 @@ LogicalLoraChannelHelper::GetSubBandFromChannel (Ptr<LogicalLoraChannel>
 Ptr<SubBand>
 LogicalLoraChannelHelper::GetSubBandFromFrequency (double frequency)
 {
+  return m_plan->subBands[GetSubBandIndex (frequency)];
+}
+
+uint32_t
+LogicalLoraChannelHelper::GetSubBandIndex (double frequency)
+{
+  // Check whether this frequency was already looked up. Since the cache
+  // doesn't change the plan, it's shared with the other helpers.
+  std::unordered_map<double, uint32_t>::const_iterator it =
+    m_plan->frequencySubBands.find (frequency);
+  if (it != m_plan->frequencySubBands.end ())
+    {
+      return it->second;
+    }
+
   // Get the SubBand this frequency belongs to
-  std::list< Ptr< SubBand > >::iterator it;
-  for (it = m_subBandList.begin (); it != m_subBandList.end (); it++)
+  for (uint32_t i = 0; i < m_plan->subBands.size (); i++)
     {
-      if ((*it)->BelongsToSubBand (frequency))
+      if (m_plan->subBands[i]->BelongsToSubBand (frequency))
         {
-          return *it;
+          m_plan->frequencySubBands[frequency] = i;
+          return i;
         }
     }
 
   NS_LOG_ERROR ("Requested frequency: " << frequency);
   NS_ABORT_MSG ("Warning: frequency is outside any known SubBand.");
 
-  return 0;     // If no SubBand is found, return 0
+  return 0;
 }
 
 void
@@ -120,14 +204,11 @@ LogicalLoraChannelHelper::AddChannel (double frequency)
 {
   NS_LOG_FUNCTION (this << frequency);
 
-  // Create the new channel and increment the counter
-  Ptr<LogicalLoraChannel> channel = Create<LogicalLoraChannel> (frequency);
-
-  // Add it to the list
-  m_channelList.push_back (channel);
+  // Create the new channel and add it to the list
+  AddChannel (Create<LogicalLoraChannel> (frequency));
 
   NS_LOG_DEBUG ("Added a channel. Current number of channels in list is " <<
-                m_channelList.size ());
+                m_plan->channels.size ());
 }
 
 void
@@ -135,8 +216,18 @@ LogicalLoraChannelHelper::AddChannel (Ptr<LogicalLoraChannel> logicalChannel)
 {
   NS_LOG_FUNCTION (this << logicalChannel);
 
+  uint32_t index = m_plan->channels.size ();
+
   // Add it to the list
-  m_channelList.push_back (logicalChannel);
+  Ptr<ChannelPlan> plan = GetWritablePlan ();
+  plan->channels.push_back (logicalChannel);
+  plan->IndexSubBands ();
+  m_enabledChannels.resize (index / 64 + 1, 0);
+
+  if (logicalChannel->IsEnabledForUplink ())
+    {
+      EnableChannel (index);
+    }
 }
 
 void
@@ -146,7 +237,18 @@ LogicalLoraChannelHelper::SetChannel (uint8_t chIndex,
 {
   NS_LOG_FUNCTION (this << chIndex << logicalChannel);
 
-  m_channelList.at (chIndex) = logicalChannel;
+  Ptr<ChannelPlan> plan = GetWritablePlan ();
+  plan->channels.at (chIndex) = logicalChannel;
+  plan->IndexSubBands ();
+
+  if (logicalChannel->IsEnabledForUplink ())
+    {
+      EnableChannel (chIndex);
+    }
+  else
+    {
+      DisableChannel (chIndex);
+    }
 }
 
 void
@@ -159,7 +261,7 @@ LogicalLoraChannelHelper::AddSubBand (double firstFrequency,
   Ptr<SubBand> subBand = Create<SubBand> (firstFrequency, lastFrequency,
                                           dutyCycle, maxTxPowerDbm);
 
-  m_subBandList.push_back (subBand);
+  AddSubBand (subBand);
 }
 
 void
@@ -167,20 +269,39 @@ LogicalLoraChannelHelper::AddSubBand (Ptr<SubBand> subBand)
 {
   NS_LOG_FUNCTION (this << subBand);
 
-  m_subBandList.push_back (subBand);
+  NS_ABORT_MSG_IF (m_plan->subBands.size () >= 64, "Too many SubBands");
+
+  Ptr<ChannelPlan> plan = GetWritablePlan ();
+  plan->subBands.push_back (subBand);
+  plan->IndexSubBands ();
+  m_nextTransmissionTimes.push_back (Seconds (0));
 }
 
 void
 LogicalLoraChannelHelper::RemoveChannel (Ptr<LogicalLoraChannel> logicalChannel)
 {
   // Search and remove the channel from the list
-  std::vector<Ptr<LogicalLoraChannel> >::iterator it;
-  for (it = m_channelList.begin (); it != m_channelList.end (); it++)
+  for (uint32_t i = 0; i < m_plan->channels.size (); i++)
     {
-      Ptr<LogicalLoraChannel> currentChannel = *it;
-      if (currentChannel == logicalChannel)
+      if (m_plan->channels[i] == logicalChannel)
         {
-          m_channelList.erase (it);
+          Ptr<ChannelPlan> plan = GetWritablePlan ();
+          plan->channels.erase (plan->channels.begin () + i);
+          plan->IndexSubBands ();
+
+          // Shift the state of the following channels down by one position,
+          // carrying the first bit of each following word into the previous
+          // one
+          uint32_t w = i / 64;
+          uint64_t lowerMask = (uint64_t (1) << (i % 64)) - 1;
+          m_enabledChannels[w] = (m_enabledChannels[w] & lowerMask) |
+            ((m_enabledChannels[w] >> 1) & ~lowerMask);
+          for (; w + 1 < m_enabledChannels.size (); w++)
+            {
+              m_enabledChannels[w] |= m_enabledChannels[w + 1] << 63;
+              m_enabledChannels[w + 1] >>= 1;
+            }
+          m_enabledChannels.resize ((plan->channels.size () + 63) / 64);
           return;
         }
     }
@@ -206,10 +327,17 @@ LogicalLoraChannelHelper::GetWaitingTime (Ptr<LogicalLoraChannel> channel)
 {
   NS_LOG_FUNCTION (this << channel);
 
+  return GetWaitingTime (channel->GetFrequency ());
+}
+
+Time
+LogicalLoraChannelHelper::GetWaitingTime (double frequency)
+{
+  NS_LOG_FUNCTION (this << frequency);
+
   // SubBand waiting time
-  Time subBandWaitingTime = GetSubBandFromChannel (channel)->
-    GetNextTransmissionTime () -
-    Simulator::Now ();
+  Time subBandWaitingTime =
+    m_nextTransmissionTimes[GetSubBandIndex (frequency)] - Simulator::Now ();
 
   // Handle case in which waiting time is negative
   subBandWaitingTime = Seconds (std::max (subBandWaitingTime.GetSeconds (),
@@ -220,20 +348,68 @@ LogicalLoraChannelHelper::GetWaitingTime (Ptr<LogicalLoraChannel> channel)
   return subBandWaitingTime;
 }
 
+Time
+LogicalLoraChannelHelper::GetMinWaitingTime (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  Time now = Simulator::Now ();
+  Time waitingTime = Time::Max ();
+  uint64_t checkedSubBands = 0;
+
+  // Go through the set bits of the channel mask, skipping the channels whose
+  // SubBand was already checked
+  for (uint32_t w = 0; w < m_enabledChannels.size (); w++)
+    {
+      for (uint64_t channels = m_enabledChannels[w]; channels != 0; channels &= channels - 1)
+        {
+          uint32_t subBand = m_plan->channelSubBands[w * 64 + __builtin_ctzll (channels)];
+
+          NS_ABORT_MSG_IF (subBand == NO_SUB_BAND,
+                           "Warning: frequency is outside any known SubBand.");
+
+          if ((checkedSubBands >> subBand) & 1)
+            {
+              continue;
+            }
+          checkedSubBands |= uint64_t (1) << subBand;
+
+          if (m_nextTransmissionTimes[subBand] <= now)
+            {
+              NS_LOG_DEBUG ("Waiting time: 0");
+              return Seconds (0);
+            }
+          waitingTime = std::min (waitingTime, m_nextTransmissionTimes[subBand] - now);
+        }
+    }
+
+  NS_LOG_DEBUG ("Waiting time: " << waitingTime.GetSeconds ());
+
+  return waitingTime;
+}
+
 void
 LogicalLoraChannelHelper::AddEvent (Time duration,
                                     Ptr<LogicalLoraChannel> channel)
 {
   NS_LOG_FUNCTION (this << duration << channel);
 
-  Ptr<SubBand> subBand = GetSubBandFromChannel (channel);
+  AddEvent (duration, channel->GetFrequency ());
+}
 
-  double dutyCycle = subBand->GetDutyCycle ();
+void
+LogicalLoraChannelHelper::AddEvent (Time duration, double frequency)
+{
+  NS_LOG_FUNCTION (this << duration << frequency);
+
+  uint32_t subBandIndex = GetSubBandIndex (frequency);
+
+  double dutyCycle = m_plan->subBands[subBandIndex]->GetDutyCycle ();
   double timeOnAir = duration.GetSeconds ();
 
   // Computation of necessary waiting time on this sub-band
-  subBand->SetNextTransmissionTime (Simulator::Now () + Seconds
-                                      (timeOnAir / dutyCycle - timeOnAir));
+  m_nextTransmissionTimes[subBandIndex] = Simulator::Now () + Seconds
+      (timeOnAir / dutyCycle - timeOnAir);
 
   // Computation of necessary aggregate waiting time
   m_nextAggregatedTransmissionTime = Simulator::Now () + Seconds
@@ -243,7 +419,7 @@ LogicalLoraChannelHelper::AddEvent (Time duration,
   NS_LOG_DEBUG ("m_aggregatedDutyCycle: " << m_aggregatedDutyCycle);
   NS_LOG_DEBUG ("Current time: " << Simulator::Now ().GetSeconds ());
   NS_LOG_DEBUG ("Next transmission on this sub-band allowed at time: " <<
-                (subBand->GetNextTransmissionTime ()).GetSeconds ());
+                m_nextTransmissionTimes[subBandIndex].GetSeconds ());
   NS_LOG_DEBUG ("Next aggregated transmission allowed at time " <<
                 m_nextAggregatedTransmissionTime.GetSeconds ());
 }
@@ -254,19 +430,16 @@ LogicalLoraChannelHelper::GetTxPowerForChannel (Ptr<LogicalLoraChannel>
 {
   NS_LOG_FUNCTION_NOARGS ();
 
-  // Get the maxTxPowerDbm from the SubBand this channel is in
-  std::list< Ptr< SubBand > >::iterator it;
-  for (it = m_subBandList.begin (); it != m_subBandList.end (); it++)
-    {
-      // Check whether this channel is in this SubBand
-      if ((*it)->BelongsToSubBand (logicalChannel->GetFrequency ()))
-        {
-          return (*it)->GetMaxTxPowerDbm ();
-        }
-    }
-  NS_ABORT_MSG ("Logical channel doesn't belong to a known SubBand");
+  return GetTxPowerForFrequency (logicalChannel->GetFrequency ());
+}
 
-  return 0;
+double
+LogicalLoraChannelHelper::GetTxPowerForFrequency (double frequency)
+{
+  NS_LOG_FUNCTION (this << frequency);
+
+  // Get the maxTxPowerDbm from the SubBand this frequency is in
+  return m_plan->subBands[GetSubBandIndex (frequency)]->GetMaxTxPowerDbm ();
 }
 
 void
@@ -274,7 +447,29 @@ LogicalLoraChannelHelper::DisableChannel (int index)
 {
   NS_LOG_FUNCTION (this << index);
 
-  m_channelList.at (index)->DisableForUplink ();
+  NS_ABORT_MSG_IF (index < 0 || uint32_t (index) >= m_plan->channels.size (),
+                   "Invalid channel index");
+  m_enabledChannels[index / 64] &= ~(uint64_t (1) << (index % 64));
+}
+
+void
+LogicalLoraChannelHelper::EnableChannel (int index)
+{
+  NS_LOG_FUNCTION (this << index);
+
+  NS_ABORT_MSG_IF (index < 0 || uint32_t (index) >= m_plan->channels.size (),
+                   "Invalid channel index");
+  m_enabledChannels[index / 64] |= uint64_t (1) << (index % 64);
+}
+
+bool
+LogicalLoraChannelHelper::IsChannelEnabled (int index) const
+{
+  if (index < 0 || uint32_t (index) / 64 >= m_enabledChannels.size ())
+    {
+      return false;
+    }
+  return (m_enabledChannels[index / 64] >> (index % 64)) & 1;
 }
 }
 }
@@ -22,11 +22,13 @@
 #define LOGICAL_LORA_CHANNEL_HELPER_H
 
 #include "ns3/object.h"
+#include "ns3/simple-ref-count.h"
 #include "ns3/logical-lora-channel.h"
 #include "ns3/nstime.h"
 #include "ns3/packet.h"
 #include "ns3/sub-band.h"
 #include <list>
+#include <unordered_map>
 #include <iterator>
 #include <vector>
 
@@ -38,9 +40,19 @@ namespace lorawan {
  * channels that the device is supposed to be using, and establishes their
  * relationship with SubBands.
  *
- * This class also takes into account duty cycle limitations, by updating a list
- * of SubBand objects and providing methods to query whether transmission on a
- * set channel is admissible or not.
+ * This class also takes into account duty cycle limitations, by keeping track
+ * of the next time at which transmission is allowed in each SubBand and
+ * providing methods to query whether transmission on a set channel is
+ * admissible or not.
+ *
+ * The channels and SubBands are kept in a plan that is shared by all the
+ * helpers that are copied from one another, and that is only duplicated when
+ * one of them modifies it. This way, devices that are configured for the same
+ * region share a single copy of the plan, and each of them only stores its
+ * duty cycle timers and a bitmask of the channels that are enabled for
+ * uplink. Since LogicalLoraChannel and SubBand objects can be shared, their
+ * state should not be modified directly: the uplink state of a channel is the
+ * one set through this helper, and SubBand transmission times are not updated.
  */
 class LogicalLoraChannelHelper : public Object
 {
@@ -72,6 +84,32 @@ public:
    */
   Time GetWaitingTime (Ptr<LogicalLoraChannel> channel);
 
+  /**
+   * Get the time it is necessary to wait for before transmitting on a given
+   * frequency.
+   *
+   * \remark This function does not take into account aggregate waiting time.
+   *
+   * \param frequency The frequency we want to know the waiting time for, in
+   * MHz.
+   * \return The waiting time before transmission is allowed on the frequency.
+   */
+  Time GetWaitingTime (double frequency);
+
+  /**
+   * Get the time it is necessary to wait for before transmitting on any of
+   * the channels that are enabled for uplink transmission.
+   *
+   * The duty cycle timer of each SubBand is checked at most once, however
+   * many of its channels are enabled.
+   *
+   * \remark This function does not take into account aggregate waiting time.
+   *
+   * \return The shortest waiting time among the enabled channels, or
+   * Time::Max if no channel is enabled.
+   */
+  Time GetMinWaitingTime (void) const;
+
   /**
    * Register the transmission of a packet.
    *
@@ -80,6 +118,14 @@ public:
    */
   void AddEvent (Time duration, Ptr<LogicalLoraChannel> channel);
 
+  /**
+   * Register the transmission of a packet.
+   *
+   * \param duration The duration of the transmission event.
+   * \param frequency The frequency the transmission was made on, in MHz.
+   */
+  void AddEvent (Time duration, double frequency);
+
   /**
    * Get the list of LogicalLoraChannels currently registered on this helper.
    *
@@ -95,6 +141,26 @@ public:
    */
   std::vector<Ptr<LogicalLoraChannel> > GetEnabledChannelList (void);
 
+  /**
+   * Get the channels that are enabled for uplink transmission, and on which
+   * the duty cycle of their SubBand currently allows to transmit.
+   *
+   * \remark This function does not take into account aggregate waiting time.
+   *
+   * \param available Set to a bitmask where bit i % 64 of word i / 64 is set
+   * if channel i is available. Its previous content is discarded.
+   * \return The number of available channels.
+   */
+  uint32_t GetAvailableChannels (std::vector<uint64_t> &available) const;
+
+  /**
+   * Get the channel at a specified index.
+   *
+   * \param index The index of the channel.
+   * \return The channel.
+   */
+  Ptr<LogicalLoraChannel> GetChannel (uint32_t index) const;
+
   /**
    * Add a new channel to the list.
    *
@@ -152,6 +218,15 @@ public:
    */
   double GetTxPowerForChannel (Ptr<LogicalLoraChannel> logicalChannel);
 
+  /**
+   * Returns the maximum transmission power [dBm] that is allowed on a
+   * frequency.
+   *
+   * \param frequency The frequency, in MHz.
+   * \return The power in dBm.
+   */
+  double GetTxPowerForFrequency (double frequency);
+
   /**
    * Get the SubBand a channel belongs to.
    *
@@ -175,18 +250,95 @@ public:
    */
   void DisableChannel (int index);
 
+  /**
+   * Enable the channel at a specified index.
+   *
+   * \param index The index of the channel to enable.
+   */
+  void EnableChannel (int index);
+
+  /**
+   * Test whether the channel at a specified index is enabled for uplink.
+   *
+   * \param index The index of the channel.
+   * \return Whether the channel is enabled.
+   */
+  bool IsChannelEnabled (int index) const;
+
 private:
   /**
-   * A list of the SubBands that are currently registered within this helper.
+   * The channels and SubBands of a region.
+   */
+  class ChannelPlan : public SimpleRefCount<LogicalLoraChannelHelper::ChannelPlan>
+  {
+  public:
+    /**
+     * The SubBands that are currently registered within this plan.
+     */
+    std::vector<Ptr<SubBand> > subBands;
+
+    /**
+     * The LogicalLoraChannels that are currently registered within this
+     * plan. The first N channels are the default ones for a fixed region.
+     */
+    std::vector<Ptr<LogicalLoraChannel> > channels;
+
+    /**
+     * The index of the SubBand each channel belongs to, or NO_SUB_BAND.
+     */
+    std::vector<uint32_t> channelSubBands;
+
+    /**
+     * The index of the SubBand of the frequencies that were looked up.
+     */
+    std::unordered_map<double, uint32_t> frequencySubBands;
+
+    /**
+     * Compute the SubBand of each channel.
+     */
+    void IndexSubBands (void);
+  };
+
+  /**
+   * The index used for channels that are not in any SubBand.
+   */
+  static const uint32_t NO_SUB_BAND = 0xffffffff;
+
+  /**
+   * Get the plan, making sure it's not shared with other helpers so that it
+   * can be modified.
+   *
+   * \return The plan.
+   */
+  Ptr<ChannelPlan> GetWritablePlan (void);
+
+  /**
+   * Get the index of the SubBand a frequency belongs to.
+   *
+   * \param frequency The frequency we want to check.
+   * \return The index of the SubBand the frequency belongs to.
+   */
+  uint32_t GetSubBandIndex (double frequency);
+
+  /**
+   * The channels and SubBands used by this helper, which may be shared with
+   * other helpers.
+   */
+  Ptr<ChannelPlan> m_plan;
+
+  /**
+   * The next time at which transmission will be possible in each SubBand of
+   * the plan.
    */
-  std::list<Ptr <SubBand> > m_subBandList;
+  std::vector<Time> m_nextTransmissionTimes;
 
   /**
-   * A vector of the LogicalLoraChannels that are currently registered within
-   * this helper. This vector represents the node's channel mask. The first N
-   * channels are the default ones for a fixed region.
+   * The channels that are enabled for uplink transmission. Bit i % 64 of word
+   * i / 64 corresponds to channel i of the plan, so that plans with more than
+   * 64 channels, like the 64 + 8 uplink channels of US915, are supported.
+   * This represents the node's channel mask.
    */
-  std::vector<Ptr <LogicalLoraChannel> > m_channelList;
+  std::vector<uint64_t> m_enabledChannels;
 
   Time m_nextAggregatedTransmissionTime; //!< The next time at which
   //!transmission will be possible
@@ -24,9 +24,14 @@
 #include "ns3/object-factory.h"
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/constant-position-mobility-model.h"
 #include "ns3/end-device-lora-phy.h"
 #include "ns3/gateway-lora-phy.h"
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 namespace ns3 {
 namespace lorawan {
@@ -52,36 +57,114 @@ LoraChannel::GetTypeId (void)
                    PointerValue (),
                    MakePointerAccessor (&LoraChannel::m_delay),
                    MakePointerChecker<PropagationDelayModel> ())
+    .AddAttribute ("SpatialCulling",
+                   "Whether to skip notifying receivers that are out of range of "
+                   "the sender. Skipped receivers do not fire any trace source for "
+                   "the packet, so out of range gateways do not count it as under "
+                   "sensitivity, and the packet is not interference for them.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoraChannel::m_spatialCulling),
+                   MakeBooleanChecker ())
+    .AddAttribute ("CullingRxPowerFloor",
+                   "The power [dBm] below which receivers are not notified of a "
+                   "transmission when SpatialCulling is enabled.",
+                   DoubleValue (-150),
+                   MakeDoubleAccessor (&LoraChannel::m_cullingRxPowerFloor),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("CullingLossModel",
+                   "The loss model used to compute the range of a transmission "
+                   "when SpatialCulling is enabled. It should give the best-case "
+                   "loss at a certain distance. If not set, the "
+                   "PropagationLossModel is used.",
+                   PointerValue (),
+                   MakePointerAccessor (&LoraChannel::m_cullingLoss),
+                   MakePointerChecker<PropagationLossModel> ())
+    .AddAttribute ("CullingGridCellSize",
+                   "The side [m] of the grid cells used to index receivers when "
+                   "SpatialCulling is enabled.",
+                   DoubleValue (1000),
+                   MakeDoubleAccessor (&LoraChannel::m_gridCellSize),
+                   MakeDoubleChecker<double> (1))
+    .AddAttribute ("CacheLinkBudget",
+                   "Whether to compute the loss and delay between two devices only "
+                   "once, and reuse them until one of the devices moves. Random "
+                   "components of the loss are drawn only once per link.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoraChannel::m_cacheLinkBudget),
+                   MakeBooleanChecker ())
     .AddTraceSource ("PacketSent",
-                     "Trace source fired whenever a packet goes out on the channel",
+                     "Trace source fired once for every packet that goes out on the channel",
                      MakeTraceSourceAccessor (&LoraChannel::m_packetSent),
                      "ns3::Packet::TracedCallback");
   return tid;
 }
 
-LoraChannel::LoraChannel ()
+LoraChannel::LoraChannel () :
+  m_spatialCulling (false),
+  m_cullingRxPowerFloor (-150),
+  m_gridCellSize (1000),
+  m_gridValid (false),
+  m_cacheLinkBudget (false)
 {
 }
 
 LoraChannel::~LoraChannel ()
 {
   m_phyList.clear ();
+  m_phyIndices.clear ();
 }
 
 LoraChannel::LoraChannel (Ptr<PropagationLossModel> loss,
                           Ptr<PropagationDelayModel> delay) :
   m_loss (loss),
-  m_delay (delay)
+  m_delay (delay),
+  m_spatialCulling (false),
+  m_cullingRxPowerFloor (-150),
+  m_gridCellSize (1000),
+  m_gridValid (false),
+  m_cacheLinkBudget (false)
 {
 }
 
+void
+LoraChannel::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::map<Ptr<MobilityModel>, uint32_t>::iterator it;
+  for (it = m_trackedMobility.begin (); it != m_trackedMobility.end (); it++)
+    {
+      it->first->TraceDisconnectWithoutContext
+        ("CourseChange", MakeCallback (&LoraChannel::CourseChanged, this));
+    }
+  m_trackedMobility.clear ();
+  m_linkBudgets.clear ();
+  m_grid.clear ();
+  m_gridValid = false;
+
+  Channel::DoDispose ();
+}
+
 void
 LoraChannel::Add (Ptr<LoraPhy> phy)
 {
   NS_LOG_FUNCTION (this << phy);
 
   // Add the new phy to the vector
+  uint32_t index = m_phyList.size ();
   m_phyList.push_back (phy);
+  m_phyIndices[phy] = index;
+
+  // End devices can only lock on packets while they are in STANDBY
+  Ptr<EndDeviceLoraPhy> edPhy = phy->GetObject<EndDeviceLoraPhy> ();
+  bool listening = edPhy == 0 || edPhy->GetState () == EndDeviceLoraPhy::STANDBY;
+  m_listening.push_back (listening);
+  if (listening)
+    {
+      m_listeners.insert (m_listeners.end (), index);
+    }
+
+  m_gridValid = false;
 }
 
 void
@@ -90,7 +173,86 @@ LoraChannel::Remove (Ptr<LoraPhy> phy)
   NS_LOG_FUNCTION (this << phy);
 
   // Remove the phy from the vector
-  m_phyList.erase (find (m_phyList.begin (), m_phyList.end (), phy));
+  std::vector<Ptr<LoraPhy> >::iterator it = find (m_phyList.begin (), m_phyList.end (), phy);
+  m_listening.erase (m_listening.begin () + (it - m_phyList.begin ()));
+  m_phyList.erase (it);
+
+  // The PHYs following the removed one changed index
+  m_phyIndices.clear ();
+  m_listeners.clear ();
+  for (uint32_t j = 0; j < m_phyList.size (); j++)
+    {
+      m_phyIndices[m_phyList[j]] = j;
+      if (m_listening[j])
+        {
+          m_listeners.insert (m_listeners.end (), j);
+        }
+    }
+
+  // Indices in the grid are no longer valid
+  m_gridValid = false;
+}
+
+void
+LoraChannel::StartListening (Ptr<LoraPhy> phy)
+{
+  NS_LOG_FUNCTION (this << phy);
+
+  std::map<Ptr<LoraPhy>, uint32_t>::const_iterator it = m_phyIndices.find (phy);
+  if (it == m_phyIndices.end () || m_listening[it->second])
+    {
+      return;
+    }
+
+  m_listening[it->second] = true;
+  m_listeners.insert (it->second);
+
+  // Transmissions that started while the PHY was not listening were not
+  // given a power at it: set it now, so that they are interference for the
+  // packets the PHY may lock on.
+  Ptr<MobilityModel> receiverMobility = phy->GetMobility ()->GetObject<MobilityModel> ();
+  std::vector<Ptr<LoraInterferenceHelper::Event> > ongoing;
+  m_interference.GetOngoingEvents (ongoing);
+  std::vector<Ptr<LoraInterferenceHelper::Event> >::const_iterator event;
+  for (event = ongoing.begin (); event != ongoing.end (); event++)
+    {
+      double rxPowerW;
+      Ptr<MobilityModel> senderMobility = (*event)->GetSenderMobility ();
+      if (senderMobility == receiverMobility
+          || (*event)->GetRxPowerW (receiverMobility, rxPowerW))
+        {
+          continue;
+        }
+
+      // Transmissions that spatial culling would not deliver to the PHY are
+      // not interference for it either
+      if (m_spatialCulling)
+        {
+          double cullingDistance = GetCullingDistance ((*event)->GetRxPowerdBm ());
+          if (cullingDistance >= 0
+              && senderMobility->GetDistanceFrom (receiverMobility) > cullingDistance)
+            {
+              continue;
+            }
+        }
+
+      double rxPowerDbm = GetRxPower ((*event)->GetRxPowerdBm (), senderMobility,
+                                      receiverMobility);
+      (*event)->SetRxPowerW (receiverMobility, std::pow (10, rxPowerDbm / 10) / 1000);
+    }
+}
+
+void
+LoraChannel::StopListening (Ptr<LoraPhy> phy)
+{
+  NS_LOG_FUNCTION (this << phy);
+
+  std::map<Ptr<LoraPhy>, uint32_t>::const_iterator it = m_phyIndices.find (phy);
+  if (it != m_phyIndices.end ())
+    {
+      m_listening[it->second] = false;
+      m_listeners.erase (it->second);
+    }
 }
 
 std::size_t
@@ -108,7 +270,7 @@ LoraChannel::GetDevice (std::size_t i) const
 void
 LoraChannel::Send (Ptr< LoraPhy > sender, Ptr< Packet > packet,
                    double txPowerDbm, LoraTxParameters txParams,
-                   Time duration, double frequencyMHz) const
+                   Time duration, double frequencyMHz)
 {
   NS_LOG_FUNCTION (this << sender << packet << txPowerDbm << txParams <<
                    duration << frequencyMHz);
@@ -118,83 +280,365 @@ LoraChannel::Send (Ptr< LoraPhy > sender, Ptr< Packet > packet,
 
   NS_ASSERT (senderMobility != 0);     // Make sure it's available
 
-  NS_LOG_INFO ("Starting cycle over all " << m_phyList.size () << " PHYs");
+  // Register the transmission once for all receivers. The power at each of
+  // them is stored in the event as it is computed below.
+  Ptr<LoraInterferenceHelper::Event> event =
+    m_interference.Add (duration, txPowerDbm, txParams.sf, packet, frequencyMHz,
+                        senderMobility);
+
+  // Fire the trace source for sent packet
+  m_packetSent (packet);
+
   NS_LOG_INFO ("Sender mobility: " << senderMobility->GetPosition ());
 
-  // Cycle over all registered PHYs
-  uint32_t j = 0;
-  std::vector<Ptr<LoraPhy> >::const_iterator i;
-  for (i = m_phyList.begin (); i != m_phyList.end (); i++, j++)
+  double cullingDistance = m_spatialCulling ? GetCullingDistance (txPowerDbm) : -1;
+
+  // If we can't cull, notify all listening PHYs
+  if (cullingDistance < 0)
     {
-      // Do not deliver to the sender (*i is the current PHY)
-      if (sender != (*i))
+      NS_LOG_INFO ("Starting cycle over " << m_listeners.size () << " of " <<
+                   m_phyList.size () << " PHYs");
+
+      std::set<uint32_t>::const_iterator i;
+      for (i = m_listeners.begin (); i != m_listeners.end (); i++)
         {
-          // Get the receiver's mobility model
-          Ptr<MobilityModel> receiverMobility = (*i)->GetMobility ()->
-            GetObject<MobilityModel> ();
+          ScheduleReceive (*i, sender, senderMobility, txPowerDbm, event);
+        }
+      return;
+    }
+
+  // Otherwise, only notify the ones that are in range
+  GetCandidateReceivers (senderMobility, cullingDistance, m_candidateReceivers);
+
+  NS_LOG_INFO ("Starting cycle over " << m_candidateReceivers.size () << " of " <<
+               m_phyList.size () << " PHYs");
+
+  std::vector<uint32_t>::const_iterator i;
+  for (i = m_candidateReceivers.begin (); i != m_candidateReceivers.end (); i++)
+    {
+      ScheduleReceive (*i, sender, senderMobility, txPowerDbm, event);
+    }
+}
+
+void
+LoraChannel::ScheduleReceive (uint32_t j, Ptr<LoraPhy> sender,
+                              Ptr<MobilityModel> senderMobility, double txPowerDbm,
+                              Ptr<LoraInterferenceHelper::Event> event)
+{
+  // Do not deliver to the sender
+  if (sender == m_phyList[j])
+    {
+      return;
+    }
+
+  // Get the receiver's mobility model
+  Ptr<MobilityModel> receiverMobility = m_phyList[j]->GetMobility ()->
+    GetObject<MobilityModel> ();
+
+  NS_LOG_INFO ("Receiver mobility: " <<
+               receiverMobility->GetPosition ());
+
+  Time delay;
+  double rxPowerDbm;
+  double rxPowerW;
+  if (m_cacheLinkBudget)
+    {
+      // Take delay and loss from the cache
+      const LinkBudget &budget = GetLinkBudget (senderMobility, receiverMobility);
+      delay = budget.delay;
+      rxPowerDbm = txPowerDbm - budget.lossDb;
+      rxPowerW = event->GetPowerW () * budget.gain;
+    }
+  else
+    {
+      // Compute delay using the delay model
+      delay = m_delay->GetDelay (senderMobility, receiverMobility);
+
+      // Compute received power using the loss model
+      rxPowerDbm = m_loss->CalcRxPower (txPowerDbm, senderMobility,
+                                        receiverMobility);
+      rxPowerW = std::pow (10, rxPowerDbm / 10) / 1000;
+    }
+
+  // This is the power the transmission has as interference at this
+  // receiver for its whole duration
+  event->SetRxPowerW (receiverMobility, rxPowerW);
+
+  NS_LOG_DEBUG ("Propagation: txPower=" << txPowerDbm <<
+                "dbm, rxPower=" << rxPowerDbm << "dbm, " <<
+                "distance=" << senderMobility->GetDistanceFrom (receiverMobility) <<
+                "m, delay=" << delay);
+
+  // Get the id of the destination PHY to correctly format the context
+  Ptr<NetDevice> dstNetDevice = m_phyList[j]->GetDevice ();
+  uint32_t dstNode = 0;
+  if (dstNetDevice != 0)
+    {
+      NS_LOG_INFO ("Getting node index from NetDevice, since it exists");
+      dstNode = dstNetDevice->GetNode ()->GetId ();
+      NS_LOG_DEBUG ("dstNode = " << dstNode);
+    }
+  else
+    {
+      NS_LOG_INFO ("No net device connected to the PHY, using context 0");
+    }
+
+  // Schedule the receive event: the packet and the parameters of the
+  // transmission are carried by the shared event
+  NS_LOG_INFO ("Scheduling reception of the packet");
+  Simulator::ScheduleWithContext (dstNode, delay, &LoraChannel::Receive,
+                                  this, j, rxPowerDbm, event);
+}
+
+void
+LoraChannel::GetCandidateReceivers (Ptr<MobilityModel> senderMobility, double cullingDistance,
+                                    std::vector<uint32_t> &receivers)
+{
+  NS_LOG_FUNCTION (this << senderMobility << cullingDistance);
 
-          NS_LOG_INFO ("Receiver mobility: " <<
-                       receiverMobility->GetPosition ());
+  receivers.clear ();
 
-          // Compute delay using the delay model
-          Time delay = m_delay->GetDelay (senderMobility, receiverMobility);
+  if (!m_gridValid)
+    {
+      BuildGrid ();
+    }
 
-          // Compute received power using the loss model
-          double rxPowerDbm = GetRxPower (txPowerDbm, senderMobility,
-                                          receiverMobility);
+  // Find the cells that may contain receivers in range. The grid is 2D, and
+  // the horizontal distance is never larger than the actual one.
+  Vector position = senderMobility->GetPosition ();
+  int64_t x = std::floor (position.x / m_gridCellSize);
+  int64_t y = std::floor (position.y / m_gridCellSize);
+  int64_t span = std::ceil (cullingDistance / m_gridCellSize);
 
-          NS_LOG_DEBUG ("Propagation: txPower=" << txPowerDbm <<
-                        "dbm, rxPower=" << rxPowerDbm << "dbm, " <<
-                        "distance=" << senderMobility->GetDistanceFrom (receiverMobility) <<
-                        "m, delay=" << delay);
+  std::vector<const std::vector<uint32_t> *> &cells = m_candidateCells;
+  cells.clear ();
+  std::map<std::pair<int64_t, int64_t>, std::vector<uint32_t> >::const_iterator cell;
+  if ((2 * span + 1) * (2 * span + 1) < int64_t (m_grid.size ()))
+    {
+      // Look up the cells around the sender
+      for (int64_t i = x - span; i <= x + span; i++)
+        {
+          for (int64_t k = y - span; k <= y + span; k++)
+            {
+              cell = m_grid.find (std::make_pair (i, k));
+              if (cell != m_grid.end ())
+                {
+                  cells.push_back (&cell->second);
+                }
+            }
+        }
+    }
+  else
+    {
+      // The range covers more cells than there are occupied ones
+      for (cell = m_grid.begin (); cell != m_grid.end (); cell++)
+        {
+          if (std::abs (cell->first.first - x) <= span &&
+              std::abs (cell->first.second - y) <= span)
+            {
+              cells.push_back (&cell->second);
+            }
+        }
+    }
 
-          // Get the id of the destination PHY to correctly format the context
-          Ptr<NetDevice> dstNetDevice = m_phyList[j]->GetDevice ();
-          uint32_t dstNode = 0;
-          if (dstNetDevice != 0)
+  // Only keep the PHYs that are actually in range
+  for (uint32_t c = 0; c < cells.size (); c++)
+    {
+      std::vector<uint32_t>::const_iterator j;
+      for (j = cells[c]->begin (); j != cells[c]->end (); j++)
+        {
+          if (!m_listening[*j])
             {
-              NS_LOG_INFO ("Getting node index from NetDevice, since it exists");
-              dstNode = dstNetDevice->GetNode ()->GetId ();
-              NS_LOG_DEBUG ("dstNode = " << dstNode);
+              continue;
             }
-          else
+
+          Ptr<MobilityModel> receiverMobility = m_phyList[*j]->GetMobility ();
+          if (senderMobility->GetDistanceFrom (receiverMobility) <= cullingDistance)
             {
-              NS_LOG_INFO ("No net device connected to the PHY, using context 0");
+              receivers.push_back (*j);
             }
+        }
+    }
+
+  // Keep the same delivery order we would have without culling
+  std::sort (receivers.begin (), receivers.end ());
 
-          // Create the parameters object based on the calculations above
-          LoraChannelParameters parameters;
-          parameters.rxPowerDbm = rxPowerDbm;
-          parameters.sf = txParams.sf;
-          parameters.duration = duration;
-          parameters.frequencyMHz = frequencyMHz;
+  NS_LOG_DEBUG ("Culled " << m_phyList.size () - receivers.size () << " receivers");
+}
+
+double
+LoraChannel::GetCullingDistance (double txPowerDbm)
+{
+  NS_LOG_FUNCTION (this << txPowerDbm);
 
-          // Schedule the receive event
-          NS_LOG_INFO ("Scheduling reception of the packet");
-          Simulator::ScheduleWithContext (dstNode, delay, &LoraChannel::Receive,
-                                          this, j, packet, parameters);
+  std::map<double, double>::const_iterator it = m_cullingDistances.find (txPowerDbm);
+  if (it != m_cullingDistances.end ())
+    {
+      return it->second;
+    }
 
-          // Fire the trace source for sent packet
-          m_packetSent (packet);
+  Ptr<PropagationLossModel> loss = m_cullingLoss != 0 ? m_cullingLoss : m_loss;
+
+  Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel> ();
+  a->SetPosition (Vector (0, 0, 0));
+
+  // Find a distance at which the power is below the floor
+  double near = 0;
+  double far = 1;
+  b->SetPosition (Vector (far, 0, 0));
+  while (loss->CalcRxPower (txPowerDbm, a, b) >= m_cullingRxPowerFloor)
+    {
+      near = far;
+      far *= 2;
+
+      // Give up culling if we can't find such a distance
+      if (far > 1e8)
+        {
+          NS_LOG_WARN ("Could not find a culling distance for txPower " << txPowerDbm);
+          m_cullingDistances[txPowerDbm] = -1;
+          return -1;
         }
+      b->SetPosition (Vector (far, 0, 0));
+    }
+
+  // Bisect between the last distance above the floor and the first one below
+  while (far - near > 1)
+    {
+      double middle = (near + far) / 2;
+      b->SetPosition (Vector (middle, 0, 0));
+      if (loss->CalcRxPower (txPowerDbm, a, b) >= m_cullingRxPowerFloor)
+        {
+          near = middle;
+        }
+      else
+        {
+          far = middle;
+        }
+    }
+
+  NS_LOG_DEBUG ("Culling distance for txPower " << txPowerDbm << " dBm is " << far << " m");
+
+  m_cullingDistances[txPowerDbm] = far;
+  return far;
+}
+
+void
+LoraChannel::BuildGrid (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_grid.clear ();
+
+  for (uint32_t j = 0; j < m_phyList.size (); j++)
+    {
+      Ptr<MobilityModel> mobility = m_phyList[j]->GetMobility ();
+
+      NS_ASSERT (mobility != 0);
+
+      Vector position = mobility->GetPosition ();
+      std::pair<int64_t, int64_t> cell (std::floor (position.x / m_gridCellSize),
+                                        std::floor (position.y / m_gridCellSize));
+      m_grid[cell].push_back (j);
+
+      // Make sure we know when this PHY moves
+      TrackMobility (mobility);
+    }
+
+  m_gridValid = true;
+}
+
+uint32_t
+LoraChannel::TrackMobility (Ptr<MobilityModel> mobility)
+{
+  std::map<Ptr<MobilityModel>, uint32_t>::iterator it = m_trackedMobility.find (mobility);
+  if (it != m_trackedMobility.end ())
+    {
+      return it->second;
+    }
+
+  NS_LOG_FUNCTION (this << mobility);
+
+  mobility->TraceConnectWithoutContext
+    ("CourseChange", MakeCallback (&LoraChannel::CourseChanged, this));
+  m_trackedMobility[mobility] = 0;
+  return 0;
+}
+
+void
+LoraChannel::CourseChanged (Ptr<const MobilityModel> mobility)
+{
+  NS_LOG_FUNCTION (this << mobility);
+
+  m_gridValid = false;
+
+  // Cached link budgets involving this device are now stale
+  m_trackedMobility[ConstCast<MobilityModel> (mobility)]++;
+}
+
+const LoraChannel::LinkBudget &
+LoraChannel::GetLinkBudget (Ptr<MobilityModel> senderMobility,
+                            Ptr<MobilityModel> receiverMobility)
+{
+  uint32_t senderGeneration = TrackMobility (senderMobility);
+  uint32_t receiverGeneration = TrackMobility (receiverMobility);
+
+  std::pair<Ptr<MobilityModel>, Ptr<MobilityModel> > link (senderMobility, receiverMobility);
+
+  std::map<std::pair<Ptr<MobilityModel>, Ptr<MobilityModel> >, LinkBudget>::iterator it =
+    m_linkBudgets.find (link);
+  if (it != m_linkBudgets.end () && it->second.senderGeneration == senderGeneration
+      && it->second.receiverGeneration == receiverGeneration)
+    {
+      return it->second;
     }
+
+  NS_LOG_DEBUG ("Computing link budget from " << senderMobility->GetPosition () <<
+                " to " << receiverMobility->GetPosition ());
+
+  LinkBudget &budget = m_linkBudgets[link];
+  budget.lossDb = -m_loss->CalcRxPower (0, senderMobility, receiverMobility);
+  budget.gain = std::pow (10, -budget.lossDb / 10);
+  budget.delay = m_delay->GetDelay (senderMobility, receiverMobility);
+  budget.senderGeneration = senderGeneration;
+  budget.receiverGeneration = receiverGeneration;
+
+  return budget;
 }
 
 void
-LoraChannel::Receive (uint32_t i, Ptr<Packet> packet,
-                      LoraChannelParameters parameters) const
+LoraChannel::Receive (uint32_t i, double rxPowerDbm,
+                      Ptr<LoraInterferenceHelper::Event> event) const
 {
-  NS_LOG_FUNCTION (this << i << packet << parameters);
+  NS_LOG_FUNCTION (this << i << rxPowerDbm << *event);
 
   // Call the appropriate PHY instance to let it begin reception
-  m_phyList[i]->StartReceive (packet, parameters.rxPowerDbm, parameters.sf,
-                              parameters.duration, parameters.frequencyMHz);
+  m_phyList[i]->StartReceive (event->GetPacket (), rxPowerDbm,
+                              event->GetSpreadingFactor (), event->GetDuration (),
+                              event->GetFrequency (), event);
+}
+
+uint8_t
+LoraChannel::IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event,
+                                        double rxPowerDbm, Ptr<LoraPhy> receiver)
+{
+  NS_LOG_FUNCTION (this << event << rxPowerDbm << receiver);
+
+  Ptr<MobilityModel> receiverMobility = receiver->GetMobility ()->GetObject<MobilityModel> ();
+
+  NS_ASSERT (receiverMobility != 0);
+
+  return m_interference.IsDestroyedByInterference (event, rxPowerDbm, receiverMobility);
 }
 
 double
 LoraChannel::GetRxPower (double txPowerDbm, Ptr<MobilityModel> senderMobility,
-                         Ptr<MobilityModel> receiverMobility) const
+                         Ptr<MobilityModel> receiverMobility)
 {
+  if (m_cacheLinkBudget)
+    {
+      return txPowerDbm - GetLinkBudget (senderMobility, receiverMobility).lossDb;
+    }
   return m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
 }
 
@@ -25,6 +25,8 @@
 #define LORA_CHANNEL_H
 
 #include <vector>
+#include <map>
+#include <set>
 #include "ns3/lora-phy.h"
 #include "ns3/mobility-model.h"
 #include "ns3/channel.h"
@@ -32,6 +34,7 @@
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
 #include "ns3/logical-lora-channel.h"
+#include "ns3/lora-interference-helper.h"
 #include "ns3/packet.h"
 #include "ns3/nstime.h"
 
@@ -69,6 +72,24 @@ std::ostream &operator << (std::ostream &os, const LoraChannelParameters &params
  * computing the power at every receiver using a PropagationLossModel and
  * notifying them of the reception event after a delay based on some
  * PropagationDelayModel.
+ *
+ * The channel also keeps a single record of all ongoing transmissions, which
+ * is shared by the connected PHYs to evaluate interference. The power of a
+ * transmission at a receiver is computed only once, when the transmission is
+ * delivered to it or, if the receiver was not listening at that time, when it
+ * starts listening, and is stored in the shared record.
+ *
+ * Optionally, the channel can skip receivers that are too far from the sender
+ * to get the packet above a certain power floor. In this case, the connected
+ * PHYs are indexed in a uniform grid based on their position, and only the
+ * ones in the cells that are within range of the sender are notified of a
+ * transmission. Skipped receivers do not perceive the transmission as
+ * interference, and do not fire any trace source for it: in particular,
+ * gateways out of range do not report it as under sensitivity.
+ *
+ * For topologies where devices seldom move, the channel can also cache the
+ * loss and delay of each sender-receiver pair the first time they are needed,
+ * and reuse them until one of the two devices moves.
  */
 class LoraChannel : public Channel
 {
@@ -114,6 +135,35 @@ public:
     */
   void Remove (Ptr<LoraPhy> phy);
 
+  /**
+    * Start delivering transmissions to a physical layer.
+    *
+    * PHYs are listening when they are added to the channel, except for end
+    * device PHYs that are in SLEEP or TX state. End device PHYs call this
+    * method when they switch to STANDBY from one of those states. The power
+    * at the PHY of the transmissions that are still ongoing is computed here,
+    * so that they are interference for the packets the PHY will lock on.
+    *
+    * \param phy The physical layer, which must have been added to the
+    * channel. Other PHYs are ignored.
+    */
+  void StartListening (Ptr<LoraPhy> phy);
+
+  /**
+    * Stop delivering transmissions to a physical layer.
+    *
+    * Transmissions that happen while a PHY is not listening are still
+    * registered as interference, and are taken into account if the PHY
+    * starts listening and locks on a packet that overlaps with them. End
+    * device PHYs call this method when they switch to SLEEP or TX. They keep
+    * listening while in RX, so that transmissions starting during a
+    * reception get a power at the PHY and interfere with it.
+    *
+    * \param phy The physical layer, which must have been added to the
+    * channel. Other PHYs are ignored.
+    */
+  void StopListening (Ptr<LoraPhy> phy);
+
   /**
     * Send a packet in the channel.
     *
@@ -131,12 +181,30 @@ public:
     *
     * \internal
     *
-    * When this method is called, the channel schedules an internal Receive call
-    * that performs the actual call to the PHY's StartReceive function.
+    * When this method is called, the transmission is registered once in the
+    * channel's interference helper, and the channel schedules an internal
+    * Receive call that performs the actual call to the PHY's StartReceive
+    * function.
     */
   void Send (Ptr<LoraPhy> sender, Ptr<Packet> packet, double txPowerDbm,
-             LoraTxParameters txParams, Time duration, double frequencyMHz)
-  const;
+             LoraTxParameters txParams, Time duration, double frequencyMHz);
+
+  /**
+    * Determine whether a transmission was destroyed by interference at a
+    * certain receiver.
+    *
+    * The power of the other transmissions registered on this channel is the
+    * one that was computed for the receiver when they were sent or when the
+    * receiver started listening: the PropagationLossModel is not used here.
+    *
+    * \param event The event of the transmission the receiver locked on.
+    * \param rxPowerDbm The power of the transmission at the receiver.
+    * \param receiver The PHY that is receiving the transmission.
+    * \return The spreading factor of the packets that caused the loss, or 0 if
+    * there was no loss.
+    */
+  uint8_t IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event,
+                                     double rxPowerDbm, Ptr<LoraPhy> receiver);
 
   /**
     * Compute the received power when transmitting from a point to another one.
@@ -149,11 +217,109 @@ public:
     * \param senderMobility The mobility model of the sender.
     * \param receiverMobility The mobility model of the receiver.
     * \return The received power in dBm.
+    *
+    * If the link budget cache is enabled, the loss between the two devices is
+    * taken from there, so that all users of the channel see the same value.
     */
   double GetRxPower (double txPowerDbm, Ptr<MobilityModel> senderMobility,
-                     Ptr<MobilityModel> receiverMobility) const;
+                     Ptr<MobilityModel> receiverMobility);
+
+protected:
+  virtual void DoDispose (void);
 
 private:
+  /**
+    * The loss and delay between a sender and a receiver.
+    */
+  struct LinkBudget
+  {
+    double lossDb;     //!< The loss, in dB.
+    double gain;     //!< The loss, as a linear factor to apply to powers in W.
+    Time delay;     //!< The propagation delay.
+    uint32_t senderGeneration;     //!< The generation of the sender's position.
+    uint32_t receiverGeneration;     //!< The generation of the receiver's position.
+  };
+
+  /**
+    * Get the loss and delay between a sender and a receiver from the cache,
+    * computing them if they are not there or if one of the devices moved
+    * since they were computed.
+    *
+    * The loss is computed at a reference transmission power, assuming the
+    * PropagationLossModel subtracts the same loss regardless of the
+    * transmission power.
+    *
+    * \param senderMobility The mobility model of the sender.
+    * \param receiverMobility The mobility model of the receiver.
+    * \return The link budget of the pair.
+    */
+  const LinkBudget &GetLinkBudget (Ptr<MobilityModel> senderMobility,
+                                   Ptr<MobilityModel> receiverMobility);
+
+  /**
+    * Start tracking the movements of a device.
+    *
+    * \param mobility The mobility model of the device.
+    * \return The generation of the device's position, which is increased
+    * every time the device moves.
+    */
+  uint32_t TrackMobility (Ptr<MobilityModel> mobility);
+
+  /**
+    * Collect the indices of the listening PHYs whose distance from the sender
+    * is below the culling distance, in the same order they have in
+    * m_phyList.
+    *
+    * This is only used when spatial culling is enabled: otherwise, the
+    * channel notifies all the PHYs in m_listeners.
+    *
+    * \param senderMobility The mobility model of the sender.
+    * \param cullingDistance The culling distance of the transmission.
+    * \param receivers The vector to fill with the indices of the receivers.
+    */
+  void GetCandidateReceivers (Ptr<MobilityModel> senderMobility, double cullingDistance,
+                              std::vector<uint32_t> &receivers);
+
+  /**
+    * Compute the power and delay of a transmission at a PHY, store the power
+    * in the transmission's event and schedule the reception at the PHY.
+    *
+    * \param j The index of the receiving PHY.
+    * \param sender The PHY that is sending the transmission, which does not
+    * receive it.
+    * \param senderMobility The mobility model of the sender.
+    * \param txPowerDbm The power of the transmission.
+    * \param event The event the transmission was registered as.
+    */
+  void ScheduleReceive (uint32_t j, Ptr<LoraPhy> sender, Ptr<MobilityModel> senderMobility,
+                        double txPowerDbm, Ptr<LoraInterferenceHelper::Event> event);
+
+  /**
+    * Compute the distance after which a transmission with a certain power
+    * reaches receivers below the culling power floor.
+    *
+    * The distance is found through a bisection on the culling loss model,
+    * assuming the loss grows with distance, and is cached for each
+    * transmission power.
+    *
+    * \param txPowerDbm The power of the transmission.
+    * \return The culling distance, or a negative value if receivers at any
+    * distance are above the floor.
+    */
+  double GetCullingDistance (double txPowerDbm);
+
+  /**
+    * Build the grid that indexes the connected PHYs based on their position.
+    */
+  void BuildGrid (void);
+
+  /**
+    * Invalidate the grid and the cached link budgets when a PHY moves.
+    *
+    * \param mobility The mobility model that changed course.
+    */
+  void CourseChanged (Ptr<const MobilityModel> mobility);
+
   /**
     * Private method that is scheduled by LoraChannel's Send method to happen
     * after the channel delay, for each of the connected PHY layers.
@@ -161,12 +327,16 @@ private:
     * It's here that the Receive method of the PHY is called to initiate packet
     * reception at the PHY.
     *
+    * The event is shared by all receivers of the transmission, and carries
+    * the packet and the parameters that characterize the transmission: only
+    * the reception power is specific to each receiver.
+    *
     * \param i The index of the phy to start reception on.
-    * \param packet The packet the phy will receive.
-    * \param parameters The parameters that characterize this transmission
+    * \param rxPowerDbm The power of the transmission at the phy.
+    * \param event The event this transmission was registered as.
     */
-  void Receive (uint32_t i, Ptr<Packet> packet,
-                LoraChannelParameters parameters) const;
+  void Receive (uint32_t i, double rxPowerDbm,
+                Ptr<LoraInterferenceHelper::Event> event) const;
 
   /**
     * The vector containing the PHYs that are currently connected to the
@@ -174,6 +344,21 @@ private:
     */
   std::vector<Ptr<LoraPhy> > m_phyList;
 
+  /**
+    * The index of each PHY in m_phyList.
+    */
+  std::map<Ptr<LoraPhy>, uint32_t> m_phyIndices;
+
+  /**
+    * Whether each PHY in m_phyList is listening.
+    */
+  std::vector<bool> m_listening;
+
+  /**
+    * The indices of the listening PHYs, in the order they have in m_phyList.
+    */
+  std::set<uint32_t> m_listeners;
+
   /**
     * Pointer to the loss model.
     *
@@ -187,6 +372,72 @@ private:
     */
   Ptr<PropagationDelayModel> m_delay;
 
+  /**
+    * The record of transmissions that happened on this channel, used to
+    * evaluate interference at the connected PHYs.
+    */
+  LoraInterferenceHelper m_interference;
+
+  /**
+    * Whether to skip receivers that are out of range of the sender.
+    */
+  bool m_spatialCulling;
+
+  /**
+    * The power below which receivers are not notified of a transmission, when
+    * spatial culling is enabled.
+    */
+  double m_cullingRxPowerFloor;
+
+  /**
+    * The loss model used to compute the culling distance. If not set, m_loss is
+    * used.
+    */
+  Ptr<PropagationLossModel> m_cullingLoss;
+
+  /**
+    * The side of the grid cells used to index the PHYs, in meters.
+    */
+  double m_gridCellSize;
+
+  /**
+    * The indices of the PHYs in each cell of the grid.
+    */
+  std::map<std::pair<int64_t, int64_t>, std::vector<uint32_t> > m_grid;
+
+  /**
+    * Scratch vectors used to collect the receivers of a transmission when
+    * spatial culling is enabled, kept across calls to avoid reallocations.
+    */
+  std::vector<uint32_t> m_candidateReceivers;
+  std::vector<const std::vector<uint32_t> *> m_candidateCells;  //!< The cells in range
+
+  /**
+    * Whether m_grid reflects the current PHYs and their positions.
+    */
+  bool m_gridValid;
+
+  /**
+    * The mobility models whose CourseChange trace source we are connected to,
+    * with the number of times they changed course.
+    */
+  std::map<Ptr<MobilityModel>, uint32_t> m_trackedMobility;
+
+  /**
+    * Whether to cache the loss and delay between devices.
+    */
+  bool m_cacheLinkBudget;
+
+  /**
+    * The cached loss and delay of each sender-receiver pair.
+    */
+  std::map<std::pair<Ptr<MobilityModel>, Ptr<MobilityModel> >, LinkBudget> m_linkBudgets;
+
+  /**
+    * The culling distance for each transmission power.
+    */
+  std::map<double, double> m_cullingDistances;
+
   /**
    * Callback for when a packet is being sent on the channel.
    */
@@ -22,6 +22,7 @@
 #define LORA_DEVICE_ADDRESS_H
 
 #include "ns3/address.h"
+#include <functional>
 #include <string>
 
 namespace ns3 {
@@ -215,5 +216,22 @@ private:
 std::ostream& operator<< (std::ostream& os, const LoraDeviceAddress &address);
 
 }
+}
+
+namespace std {
+
+/**
+ * Hash a LoraDeviceAddress through its 32-bit representation, so that it can
+ * be used as the key of unordered containers.
+ */
+template <>
+struct hash<ns3::lorawan::LoraDeviceAddress>
+{
+  size_t operator() (const ns3::lorawan::LoraDeviceAddress &address) const
+  {
+    return hash<uint32_t> () (address.Get ());
+  }
+};
+
 }
 #endif
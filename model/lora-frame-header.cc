@@ -385,6 +385,22 @@ LoraFrameHeader::GetAddress (void) const
   return m_address;
 }
 
+LoraDeviceAddress
+LoraFrameHeader::PeekAddress (Ptr<const Packet> packet)
+{
+  NS_LOG_FUNCTION (packet);
+
+  // The address follows the one byte MAC header, and Serialize writes it with
+  // WriteU32, i.e., least significant byte first
+  uint8_t buf[5];
+  NS_ASSERT (packet->GetSize () >= sizeof (buf));
+  packet->CopyData (buf, sizeof (buf));
+
+  uint32_t address = buf[1] | uint32_t (buf[2]) << 8 |
+    uint32_t (buf[3]) << 16 | uint32_t (buf[4]) << 24;
+  return LoraDeviceAddress (address);
+}
+
 void
 LoraFrameHeader::SetAdr (bool adr)
 {
@@ -22,6 +22,7 @@
 #define LORA_FRAME_HEADER_H
 
 #include "ns3/header.h"
+#include "ns3/packet.h"
 #include "ns3/lora-device-address.h"
 #include "ns3/mac-command.h"
 
@@ -126,6 +127,19 @@ public:
    */
   LoraDeviceAddress GetAddress (void) const;
 
+  /**
+   * Read the device address of an uplink packet.
+   *
+   * Only the first five bytes of the packet are read: the address is taken
+   * from its fixed offset after the one byte MAC header, without
+   * deserializing the frame options and the rest of the frame header.
+   *
+   * \param packet The packet, starting with a LorawanMacHeader followed by a
+   * LoraFrameHeader.
+   * \return The device address stored in the frame header.
+   */
+  static LoraDeviceAddress PeekAddress (Ptr<const Packet> packet);
+
   /**
    * Set the Adr value.
    *
@@ -21,6 +21,8 @@
 #include "ns3/lora-interference-helper.h"
 #include "ns3/log.h"
 #include "ns3/enum.h"
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 namespace ns3 {
@@ -37,10 +39,33 @@ LoraInterferenceHelper::Event::Event (Time duration, double rxPowerdBm, uint8_t
                                       Ptr<Packet> packet, double frequencyMHz)
     : m_startTime (Simulator::Now ()),
       m_endTime (m_startTime + duration),
+      m_startTick (m_startTime.GetTimeStep ()),
+      m_endTick (m_endTime.GetTimeStep ()),
       m_sf (spreadingFactor),
       m_rxPowerdBm (rxPowerdBm),
+      m_powerW (std::pow (10, rxPowerdBm / 10) / 1000),
       m_packet (packet),
-      m_frequencyMHz (frequencyMHz)
+      m_frequencyMHz (frequencyMHz),
+      m_senderMobility (0),
+      m_rxPowersSorted (true)
+{
+  // NS_LOG_FUNCTION_NOARGS ();
+}
+
+LoraInterferenceHelper::Event::Event (Time duration, double txPowerDbm, uint8_t spreadingFactor,
+                                      Ptr<Packet> packet, double frequencyMHz,
+                                      Ptr<MobilityModel> senderMobility)
+    : m_startTime (Simulator::Now ()),
+      m_endTime (m_startTime + duration),
+      m_startTick (m_startTime.GetTimeStep ()),
+      m_endTick (m_endTime.GetTimeStep ()),
+      m_sf (spreadingFactor),
+      m_rxPowerdBm (txPowerDbm),
+      m_powerW (std::pow (10, txPowerDbm / 10) / 1000),
+      m_packet (packet),
+      m_frequencyMHz (frequencyMHz),
+      m_senderMobility (senderMobility),
+      m_rxPowersSorted (true)
 {
   // NS_LOG_FUNCTION_NOARGS ();
 }
@@ -76,6 +101,24 @@ LoraInterferenceHelper::Event::GetRxPowerdBm (void) const
   return m_rxPowerdBm;
 }
 
+double
+LoraInterferenceHelper::Event::GetPowerW (void) const
+{
+  return m_powerW;
+}
+
+int64_t
+LoraInterferenceHelper::Event::GetStartTick (void) const
+{
+  return m_startTick;
+}
+
+int64_t
+LoraInterferenceHelper::Event::GetEndTick (void) const
+{
+  return m_endTick;
+}
+
 uint8_t
 LoraInterferenceHelper::Event::GetSpreadingFactor (void) const
 {
@@ -94,6 +137,49 @@ LoraInterferenceHelper::Event::GetFrequency (void) const
   return m_frequencyMHz;
 }
 
+Ptr<MobilityModel>
+LoraInterferenceHelper::Event::GetSenderMobility (void) const
+{
+  return m_senderMobility;
+}
+
+void
+LoraInterferenceHelper::Event::SetRxPowerW (Ptr<MobilityModel> receiverMobility, double rxPowerW)
+{
+  // Receivers are usually added in bulk when the transmission is sent, so we
+  // only sort them once, at the first lookup.
+  if (m_rxPowersSorted && !m_rxPowersW.empty () && receiverMobility < m_rxPowersW.back ().first)
+    {
+      m_rxPowersSorted = false;
+    }
+  m_rxPowersW.push_back (std::make_pair (receiverMobility, rxPowerW));
+}
+
+bool
+LoraInterferenceHelper::Event::GetRxPowerW (Ptr<MobilityModel> receiverMobility,
+                                            double &rxPowerW) const
+{
+  typedef std::pair<Ptr<MobilityModel>, double> RxPower;
+
+  if (!m_rxPowersSorted)
+    {
+      std::sort (m_rxPowersW.begin (), m_rxPowersW.end (),
+                 [] (const RxPower &a, const RxPower &b) { return a.first < b.first; });
+      m_rxPowersSorted = true;
+    }
+
+  std::vector<RxPower>::const_iterator it =
+      std::lower_bound (m_rxPowersW.begin (), m_rxPowersW.end (), receiverMobility,
+                        [] (const RxPower &a, const Ptr<MobilityModel> &b) { return a.first < b; });
+  if (it == m_rxPowersW.end () || it->first != receiverMobility)
+    {
+      return false;
+    }
+
+  rxPowerW = it->second;
+  return true;
+}
+
 void
 LoraInterferenceHelper::Event::Print (std::ostream &stream) const
 {
@@ -159,6 +245,16 @@ LoraInterferenceHelper::SetCollisionMatrix (
       m_collisionSnir = LoraInterferenceHelper::collisionSnirGoursaud;
       break;
     }
+
+  // Convert the thresholds once, so that they can be compared to energy
+  // ratios. The infinite isolations of the ALOHA matrix become inf and 0.
+  for (unsigned i = 0; i < 6; i++)
+    {
+      for (unsigned j = 0; j < 6; j++)
+        {
+          m_collisionSnirLinear[i][j] = std::pow (10, m_collisionSnir[i][j] / 10);
+        }
+    }
 }
 
 TypeId
@@ -170,7 +266,8 @@ LoraInterferenceHelper::GetTypeId (void)
   return tid;
 }
 
-  LoraInterferenceHelper::LoraInterferenceHelper () : m_collisionSnir(LoraInterferenceHelper::collisionSnirGoursaud)
+  LoraInterferenceHelper::LoraInterferenceHelper () : m_collisionSnir(LoraInterferenceHelper::collisionSnirGoursaud),
+    m_maxDuration (Seconds (0))
 {
   NS_LOG_FUNCTION (this);
 
@@ -196,15 +293,43 @@ LoraInterferenceHelper::Add (Time duration, double rxPower, uint8_t spreadingFac
   Ptr<LoraInterferenceHelper::Event> event = Create<LoraInterferenceHelper::Event> (
       duration, rxPower, spreadingFactor, packet, frequencyMHz);
 
-  // Add the event to the list
-  m_events.push_back (event);
+  return Insert (event);
+}
 
-  // Clean the event list
-  if (m_events.size () > 100)
+Ptr<LoraInterferenceHelper::Event>
+LoraInterferenceHelper::Add (Time duration, double txPowerDbm, uint8_t spreadingFactor,
+                             Ptr<Packet> packet, double frequencyMHz,
+                             Ptr<MobilityModel> senderMobility)
+{
+  NS_LOG_FUNCTION (this << duration.GetSeconds () << txPowerDbm << unsigned(spreadingFactor)
+                        << packet << frequencyMHz << senderMobility);
+
+  // Create a shared event, whose power at each receiver is computed later
+  Ptr<LoraInterferenceHelper::Event> event = Create<LoraInterferenceHelper::Event> (
+      duration, txPowerDbm, spreadingFactor, packet, frequencyMHz, senderMobility);
+
+  return Insert (event);
+}
+
+Ptr<LoraInterferenceHelper::Event>
+LoraInterferenceHelper::Insert (Ptr<LoraInterferenceHelper::Event> event)
+{
+  NS_LOG_FUNCTION (this << event);
+
+  if (event->GetDuration () > m_maxDuration)
     {
-      CleanOldEvents ();
+      m_maxDuration = event->GetDuration ();
     }
 
+  // Add the event to the bucket of its frequency. Events are added at the
+  // current time, so most of them end up at the back of the bucket.
+  std::multimap<Time, Ptr<LoraInterferenceHelper::Event>> &events =
+      m_events[event->GetFrequency ()];
+  events.insert (events.end (), std::make_pair (event->GetEndTime (), event));
+
+  // Clean the bucket: this only touches the events that expired
+  CleanOldEvents (events);
+
   return event;
 }
 
@@ -213,24 +338,56 @@ LoraInterferenceHelper::CleanOldEvents (void)
 {
   NS_LOG_FUNCTION (this);
 
-  // Cycle the events, and clean up if an event is old.
-  for (auto it = m_events.begin (); it != m_events.end ();)
+  for (auto it = m_events.begin (); it != m_events.end (); ++it)
     {
-      if ((*it)->GetEndTime () + oldEventThreshold < Simulator::Now ())
-        {
-          it = m_events.erase (it);
-        }
-      else
-        {
-          it++;
-        }
+      CleanOldEvents (it->second);
+    }
+}
+
+void
+LoraInterferenceHelper::CleanOldEvents (
+    std::multimap<Time, Ptr<LoraInterferenceHelper::Event>> &events)
+{
+  // An event can be removed once it cannot overlap with any packet that may
+  // still be evaluated, i.e., one that ended at most m_maxDuration ago.
+  Time threshold = std::max (oldEventThreshold, m_maxDuration);
+
+  // Events are sorted by end time: stop at the first one that is not old.
+  while (!events.empty () && events.begin ()->first + threshold < Simulator::Now ())
+    {
+      events.erase (events.begin ());
     }
 }
 
 std::list<Ptr<LoraInterferenceHelper::Event>>
 LoraInterferenceHelper::GetInterferers ()
 {
-  return m_events;
+  std::list<Ptr<LoraInterferenceHelper::Event>> interferers;
+
+  for (auto it = m_events.begin (); it != m_events.end (); ++it)
+    {
+      for (auto jt = it->second.begin (); jt != it->second.end (); ++jt)
+        {
+          interferers.push_back (jt->second);
+        }
+    }
+
+  return interferers;
+}
+
+void
+LoraInterferenceHelper::GetOngoingEvents (std::vector<Ptr<LoraInterferenceHelper::Event>> &events)
+{
+  NS_LOG_FUNCTION (this);
+
+  // Buckets are sorted by end time: skip the events that already ended
+  for (auto it = m_events.begin (); it != m_events.end (); ++it)
+    {
+      for (auto jt = it->second.upper_bound (Simulator::Now ()); jt != it->second.end (); ++jt)
+        {
+          events.push_back (jt->second);
+        }
+    }
 }
 
 void
@@ -242,116 +399,148 @@ LoraInterferenceHelper::PrintEvents (std::ostream &stream)
 
   for (auto it = m_events.begin (); it != m_events.end (); it++)
     {
-      (*it)->Print (stream);
-      stream << std::endl;
+      for (auto jt = it->second.begin (); jt != it->second.end (); jt++)
+        {
+          jt->second->Print (stream);
+          stream << std::endl;
+        }
     }
 }
 
 uint8_t
 LoraInterferenceHelper::IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event)
 {
-  NS_LOG_FUNCTION (this << event);
+  return IsDestroyedByInterference (event, event->GetRxPowerdBm (), 0);
+}
 
-  NS_LOG_INFO ("Current number of events in LoraInterferenceHelper: " << m_events.size ());
+uint8_t
+LoraInterferenceHelper::IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event,
+                                                   double rxPowerDbm,
+                                                   Ptr<MobilityModel> receiverMobility)
+{
+  NS_LOG_FUNCTION (this << event << rxPowerDbm << receiverMobility);
 
   // We want to see the interference affecting this event: cycle through events
   // that overlap with this one and see whether it survives the interference or
   // not.
 
   // Gather information about the event
-  double rxPowerDbm = event->GetRxPowerdBm ();
   uint8_t sf = event->GetSpreadingFactor ();
   double frequency = event->GetFrequency ();
 
   // Handy information about the time frame when the packet was received
-  Time now = Simulator::Now ();
-  Time duration = event->GetDuration ();
-  Time packetStartTime = now - duration;
-  Time packetEndTime = now;
-
-  // Get the list of interfering events
-  std::list<Ptr<LoraInterferenceHelper::Event>>::iterator it;
-
-  // Energy for interferers of various SFs
-  std::vector<double> cumulativeInterferenceEnergy (6, 0);
-
-  // Cycle over the events
-  for (it = m_events.begin (); it != m_events.end ();)
+  Time packetStartTime = event->GetStartTime ();
+  Time packetEndTime = event->GetEndTime ();
+  int64_t packetStartTick = event->GetStartTick ();
+  int64_t packetEndTick = event->GetEndTick ();
+
+  // Only consider events on the same channel: we assume there's no
+  // interchannel interference.
+  std::map<double, std::multimap<Time, Ptr<LoraInterferenceHelper::Event>>>::iterator bucket =
+      m_events.find (frequency);
+  std::multimap<Time, Ptr<LoraInterferenceHelper::Event>> noEvents;
+  std::multimap<Time, Ptr<LoraInterferenceHelper::Event>> &events =
+      bucket != m_events.end () ? bucket->second : noEvents;
+
+  NS_LOG_INFO ("Current number of events on this frequency: " << events.size ());
+
+  // Events ending before this one starts cannot overlap with it, and events
+  // ending after m_maxDuration past its end started after it ended.
+  std::multimap<Time, Ptr<LoraInterferenceHelper::Event>>::iterator it =
+      events.upper_bound (packetStartTime);
+  std::multimap<Time, Ptr<LoraInterferenceHelper::Event>>::iterator last =
+      events.upper_bound (packetEndTime + m_maxDuration);
+
+  m_interfererEnergy.clear ();
+  m_interfererPowerW.clear ();
+  m_interfererSfIndex.clear ();
+
+  // Gather the overlap, power and SF of the interferers
+  for (; it != last; it++)
     {
       // Pointer to the current interferer
-      Ptr<LoraInterferenceHelper::Event> interferer = *it;
+      const Ptr<LoraInterferenceHelper::Event> &interferer = it->second;
 
-      // Only consider the current event if the channel is the same: we
-      // assume there's no interchannel interference. Also skip the current
-      // event if it's the same that we want to analyze.
-      if (!(interferer->GetFrequency () == frequency) || interferer == event)
+      // Skip the current event if it's the same that we want to analyze, or
+      // if it started after it.
+      if (interferer == event || interferer->GetStartTick () >= packetEndTick)
         {
-          NS_LOG_DEBUG ("Different channel or same event");
-          it++;
+          NS_LOG_DEBUG ("Same event or no overlap");
           continue; // Continues from the first line inside the for cycle
         }
 
-      NS_LOG_DEBUG ("Interferer on same channel");
-
-      // Gather information about this interferer
-      uint8_t interfererSf = interferer->GetSpreadingFactor ();
-      double interfererPower = interferer->GetRxPowerdBm ();
-      Time interfererStartTime = interferer->GetStartTime ();
-      Time interfererEndTime = interferer->GetEndTime ();
-
-      NS_LOG_INFO ("Found an interferer: sf = " << unsigned(interfererSf)
-                                                << ", power = " << interfererPower
-                                                << ", start time = " << interfererStartTime
-                                                << ", end time = " << interfererEndTime);
-
-      // Compute the fraction of time the two events are overlapping
-      Time overlap = GetOverlapTime (event, interferer);
-
-      NS_LOG_DEBUG ("The two events overlap for " << overlap.GetSeconds () << " s.");
-
-      // Compute the equivalent energy of the interference
-      // Power [mW] = 10^(Power[dBm]/10)
-      // Power [W] = Power [mW] / 1000
-      double interfererPowerW = pow (10, interfererPower / 10) / 1000;
-      // Energy [J] = Time [s] * Power [W]
-      double interferenceEnergy = overlap.GetSeconds () * interfererPowerW;
-      cumulativeInterferenceEnergy.at (unsigned(interfererSf) - 7) += interferenceEnergy;
-      NS_LOG_DEBUG ("Interferer power in W: " << interfererPowerW);
-      NS_LOG_DEBUG ("Interference energy: " << interferenceEnergy);
-      it++;
+      // Our own transmissions are not interference
+      const Ptr<MobilityModel> &interfererMobility = interferer->GetSenderMobility ();
+      if (interfererMobility != 0 && interfererMobility == receiverMobility)
+        {
+          NS_LOG_DEBUG ("Event was sent by the receiver");
+          continue;
+        }
+
+      // Shared events carry the power they have at each receiver they reach
+      double interfererPowerW = interferer->GetPowerW ();
+      if (interfererMobility != 0 && !interferer->GetRxPowerW (receiverMobility, interfererPowerW))
+        {
+          NS_LOG_DEBUG ("Event does not reach the receiver");
+          continue;
+        }
+
+      // Since the interferer ends after this event starts and starts before
+      // it ends, the two events overlap.
+      int64_t overlap = std::min (packetEndTick, interferer->GetEndTick ()) -
+                        std::max (packetStartTick, interferer->GetStartTick ());
+
+      NS_LOG_INFO ("Found an interferer: sf = " << unsigned(interferer->GetSpreadingFactor ())
+                                                << ", power = " << interfererPowerW
+                                                << " W, overlap = " << overlap << " steps");
+
+      m_interfererEnergy.push_back (overlap);
+      m_interfererPowerW.push_back (interfererPowerW);
+      m_interfererSfIndex.push_back (interferer->GetSpreadingFactor () - 7);
+    }
+
+  // Energy [J] = Time [s] * Power [W]. Energies are only compared with each
+  // other, so they are kept in time steps * W. This loop has no dependencies
+  // between iterations, and can be vectorized by the compiler.
+  std::size_t nInterferers = m_interfererEnergy.size ();
+  double *energy = m_interfererEnergy.data ();
+  const double *powerW = m_interfererPowerW.data ();
+  for (std::size_t i = 0; i < nInterferers; i++)
+    {
+      energy[i] *= powerW[i];
+    }
+
+  // Energy for interferers of various SFs
+  double cumulativeInterferenceEnergy[6] = {0, 0, 0, 0, 0, 0};
+  for (std::size_t i = 0; i < nInterferers; i++)
+    {
+      cumulativeInterferenceEnergy[m_interfererSfIndex[i]] += energy[i];
     }
 
-  // For each SF, check if there was destructive interference
+  double signalPowerW = std::pow (10, rxPowerDbm / 10) / 1000;
+  double signalEnergy = (packetEndTick - packetStartTick) * signalPowerW;
+  NS_LOG_DEBUG ("Signal power in W: " << signalPowerW);
+
+  // For each SF, check if there was destructive interference, i.e., whether
+  // the SNIR is below the isolation required to survive.
+  const double *snirIsolation = m_collisionSnirLinear[unsigned(sf) - 7];
   for (uint8_t currentSf = uint8_t (7); currentSf <= uint8_t (12); currentSf++)
     {
-      NS_LOG_DEBUG ("Cumulative Interference Energy: "
-                    << cumulativeInterferenceEnergy.at (unsigned(currentSf) - 7));
-
-      // Use the computed cumulativeInterferenceEnergy to determine whether the
-      // interference with this SF destroys the packet
-      double signalPowerW = pow (10, rxPowerDbm / 10) / 1000;
-      double signalEnergy = duration.GetSeconds () * signalPowerW;
-      NS_LOG_DEBUG ("Signal power in W: " << signalPowerW);
-      NS_LOG_DEBUG ("Signal energy: " << signalEnergy);
-
-      // Check whether the packet survives the interference of this SF
-      double snirIsolation = m_collisionSnir[unsigned(sf) - 7][unsigned(currentSf) - 7];
-      NS_LOG_DEBUG ("The needed isolation to survive is " << snirIsolation << " dB");
-      double snir =
-          10 * log10 (signalEnergy / cumulativeInterferenceEnergy.at (unsigned(currentSf) - 7));
-      NS_LOG_DEBUG ("The current SNIR is " << snir << " dB");
-
-      if (snir >= snirIsolation)
-        {
-          // Move on and check the rest of the interferers
-          NS_LOG_DEBUG ("Packet survived interference with SF " << currentSf);
-        }
-      else
+      double interferenceEnergy = cumulativeInterferenceEnergy[unsigned(currentSf) - 7];
+      NS_LOG_DEBUG ("Cumulative Interference Energy: " << interferenceEnergy);
+
+      // Without interference the SNIR is infinite. Checking this first also
+      // avoids multiplying the infinite isolation of the ALOHA matrix by 0.
+      if (interferenceEnergy > 0
+          && signalEnergy < snirIsolation[unsigned(currentSf) - 7] * interferenceEnergy)
         {
           NS_LOG_DEBUG ("Packet destroyed by interference with SF" << unsigned(currentSf));
 
           return currentSf;
         }
+
+      // Move on and check the rest of the interferers
+      NS_LOG_DEBUG ("Packet survived interference with SF " << unsigned(currentSf));
     }
   // If we get to here, it means that the packet survived all interference
   NS_LOG_DEBUG ("Packet survived all interference");
@@ -366,6 +555,7 @@ LoraInterferenceHelper::ClearAllEvents (void)
   NS_LOG_FUNCTION_NOARGS ();
 
   m_events.clear ();
+  m_maxDuration = Seconds (0);
 }
 
 Time
@@ -27,18 +27,28 @@
 #include "ns3/traced-callback.h"
 #include "ns3/callback.h"
 #include "ns3/packet.h"
+#include "ns3/mobility-model.h"
 #include "ns3/logical-lora-channel.h"
 #include <list>
+#include <map>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
 
 /**
- * Helper for LoraPhy that manages interference calculations.
+ * Helper that manages interference calculations.
  *
  * This class keeps a list of signals that are impinging on the antenna of the
  * device, in order to compute which ones can be correctly received and which
  * ones are lost due to interference.
+ *
+ * The helper can also be used as a registry of all transmissions that happen
+ * on a LoraChannel. In this case, events are added only once, with the power
+ * at the transmitter and the mobility model of the sender, and the channel
+ * stores in each event the power it has at the receivers it reaches. The
+ * helper never computes powers itself: a shared event that has no power at a
+ * receiver is not interference for that receiver.
  */
 class LoraInterferenceHelper
 {
@@ -55,6 +65,20 @@ public:
   public:
     Event (Time duration, double rxPowerdBm, uint8_t spreadingFactor, Ptr<Packet> packet,
            double frequencyMHz);
+
+    /**
+     * Create an event that is shared by all receivers of a transmission.
+     *
+     * \param duration The duration of the transmission.
+     * \param txPowerDbm The power used by the transmitter, in dBm.
+     * \param spreadingFactor The spreading factor used by the transmission.
+     * \param packet The packet carried by this transmission.
+     * \param frequencyMHz The frequency this transmission happens at.
+     * \param senderMobility The mobility model of the sender.
+     */
+    Event (Time duration, double txPowerDbm, uint8_t spreadingFactor, Ptr<Packet> packet,
+           double frequencyMHz, Ptr<MobilityModel> senderMobility);
+
     ~Event ();
 
     /**
@@ -74,9 +98,31 @@ public:
 
     /**
      * Get the power of the event.
+     *
+     * For events that are shared by all receivers (i.e., that have a sender
+     * mobility model), this is the power at the transmitter.
      */
     double GetRxPowerdBm (void) const;
 
+    /**
+     * Get the power of the event in W.
+     *
+     * This is the same power returned by GetRxPowerdBm, converted once when
+     * the event is created so that interference computations can work in the
+     * linear domain.
+     */
+    double GetPowerW (void) const;
+
+    /**
+     * Get the starting time of the event, in simulator time steps.
+     */
+    int64_t GetStartTick (void) const;
+
+    /**
+     * Get the ending time of the event, in simulator time steps.
+     */
+    int64_t GetEndTick (void) const;
+
     /**
      * Get the spreading factor used by this signal.
      */
@@ -92,6 +138,34 @@ public:
      */
     double GetFrequency (void) const;
 
+    /**
+     * Get the mobility model of the device that sent this event.
+     *
+     * \return The mobility model of the sender, or 0 if the event was added
+     * with a power that is already the one at the receiver.
+     */
+    Ptr<MobilityModel> GetSenderMobility (void) const;
+
+    /**
+     * Set the power of this shared event at a receiver.
+     *
+     * The power should be computed only once for each receiver, so that all
+     * the users of the event see the same value.
+     *
+     * \param receiverMobility The mobility model of the receiver.
+     * \param rxPowerW The power of the event at the receiver, in W.
+     */
+    void SetRxPowerW (Ptr<MobilityModel> receiverMobility, double rxPowerW);
+
+    /**
+     * Get the power of this shared event at a receiver.
+     *
+     * \param receiverMobility The mobility model of the receiver.
+     * \param rxPowerW Set to the power of the event at the receiver, in W.
+     * \return Whether a power was set for the receiver.
+     */
+    bool GetRxPowerW (Ptr<MobilityModel> receiverMobility, double &rxPowerW) const;
+
     /**
      * Print the current event in a human readable form.
      */
@@ -108,6 +182,12 @@ public:
      */
     Time m_endTime;
 
+    /**
+     * The start and end times of this signal, in simulator time steps.
+     */
+    int64_t m_startTick;
+    int64_t m_endTick;
+
     /**
      * The spreading factor of this signal.
      */
@@ -118,6 +198,11 @@ public:
      */
     double m_rxPowerdBm;
 
+    /**
+     * The power of this event in W (at the device).
+     */
+    double m_powerW;
+
     /**
      * The packet this event was generated for.
      */
@@ -127,6 +212,23 @@ public:
      * The frequency this event was on.
      */
     double m_frequencyMHz;
+
+    /**
+     * The mobility model of the sender, if this event is shared among
+     * receivers.
+     */
+    Ptr<MobilityModel> m_senderMobility;
+
+    /**
+     * The power of this shared event at each receiver, in W, sorted by
+     * receiver when a lookup needs it.
+     */
+    mutable std::vector<std::pair<Ptr<MobilityModel>, double> > m_rxPowersW;
+
+    /**
+     * Whether m_rxPowersW is sorted by receiver.
+     */
+    mutable bool m_rxPowersSorted;
   };
 
   enum CollisionMatrix {
@@ -153,12 +255,40 @@ public:
   Ptr<LoraInterferenceHelper::Event> Add (Time duration, double rxPower, uint8_t spreadingFactor,
                                           Ptr<Packet> packet, double frequencyMHz);
 
+  /**
+   * Add an event that is shared by all the receivers of a transmission.
+   *
+   * The power of the event at each receiver is not computed here: it must be
+   * set on the returned event through Event::SetRxPowerW.
+   *
+   * \param duration the duration of the packet.
+   * \param txPowerDbm the transmission power in dBm.
+   * \param spreadingFactor the spreading factor used by the transmission.
+   * \param packet The packet carried by this transmission.
+   * \param frequencyMHz The frequency this event was sent at.
+   * \param senderMobility The mobility model of the sender.
+   *
+   * \return the newly created event
+   */
+  Ptr<LoraInterferenceHelper::Event> Add (Time duration, double txPowerDbm,
+                                          uint8_t spreadingFactor, Ptr<Packet> packet,
+                                          double frequencyMHz,
+                                          Ptr<MobilityModel> senderMobility);
+
   /**
    * Get a list of the interferers currently registered at this
    * InterferenceHelper.
    */
   std::list<Ptr<LoraInterferenceHelper::Event>> GetInterferers ();
 
+  /**
+   * Get the events that have not ended yet, i.e., the ones that can still
+   * interfere with a packet that starts now.
+   *
+   * \param events The vector to fill with the ongoing events.
+   */
+  void GetOngoingEvents (std::vector<Ptr<LoraInterferenceHelper::Event>> &events);
+
   /**
    * Print the events that are saved in this helper in a human readable format.
    */
@@ -175,6 +305,25 @@ public:
    */
   uint8_t IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event);
 
+  /**
+   * Determine whether the event was destroyed by interference at a certain
+   * receiver.
+   *
+   * The power of interferers that are shared among receivers is the one that
+   * was set for this receiver, while the other ones are taken as they were
+   * registered. Events that were sent by the receiver itself, and shared
+   * events that have no power at the receiver, are not considered as
+   * interference.
+   *
+   * \param event The event for which to check the outcome.
+   * \param rxPowerDbm The power of the event at the receiver.
+   * \param receiverMobility The mobility model of the receiver.
+   * \return The sf of the packets that caused the loss, or 0 if there was no
+   * loss.
+   */
+  uint8_t IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event,
+                                     double rxPowerDbm, Ptr<MobilityModel> receiverMobility);
+
   /**
    * Compute the time duration in which two given events are overlapping.
    *
@@ -193,6 +342,9 @@ public:
 
   /**
    * Delete old events in this LoraInterferenceHelper.
+   *
+   * Since events are kept sorted by end time, only the oldest events of each
+   * frequency are visited.
    */
   void CleanOldEvents (void);
 
@@ -204,12 +356,60 @@ public:
 private:
   void SetCollisionMatrix (enum CollisionMatrix collisionMatrix);
 
+  /**
+   * Store a newly created event and expire the old ones on its frequency.
+   *
+   * \param event The event to store.
+   * \return The stored event.
+   */
+  Ptr<LoraInterferenceHelper::Event> Insert (Ptr<LoraInterferenceHelper::Event> event);
+
+  /**
+   * Delete old events that are on a certain frequency.
+   *
+   * \param events The events of one frequency, sorted by end time.
+   */
+  void CleanOldEvents (std::multimap<Time, Ptr<LoraInterferenceHelper::Event>> &events);
+
   std::vector<std::vector<double>> m_collisionSnir;
 
   /**
-   * A list of the events this LoraInterferenceHelper is keeping track of.
+   * The collision matrix in the linear domain, i.e., the minimum ratio
+   * between the energy of a packet and the energy of the interferers of each
+   * SF for the packet to survive.
+   */
+  double m_collisionSnirLinear[6][6];
+
+  /**
+   * Scratch arrays filled with the overlapping interferers of the packet
+   * that is being evaluated, kept across calls to avoid reallocations.
+   *
+   * The overlap of each interferer is first stored in time steps, and then
+   * multiplied by its power to obtain its energy.
+   */
+  std::vector<double> m_interfererEnergy;
+  std::vector<double> m_interfererPowerW;  //!< The power of each interferer
+  std::vector<uint8_t> m_interfererSfIndex;  //!< The SF of each interferer, minus 7
+
+  /**
+   * The events this LoraInterferenceHelper is keeping track of, bucketed by
+   * frequency and sorted by end time.
+   *
+   * Since we assume there is no inter-channel interference, an overlap query
+   * only needs to look at the bucket of the event's frequency, and can jump
+   * to the first event ending after the start of the event of interest.
+   */
+  std::map<double, std::multimap<Time, Ptr<LoraInterferenceHelper::Event>>> m_events;
+
+  /**
+   * The longest duration among the events that were added to this helper.
+   *
+   * Events ending later than the end of a packet plus this duration cannot
+   * overlap with it, which bounds the number of events an overlap query
+   * visits. It also prevents events from expiring while they can still
+   * interfere with a packet that is being evaluated.
    */
-  std::list<Ptr<LoraInterferenceHelper::Event>> m_events;
+  Time m_maxDuration;
 
   /**
    * The matrix containing information about how packets survive interference.
@@ -22,6 +22,9 @@
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
@@ -157,27 +160,67 @@ LoraPhy::SetTxFinishedCallback (TxFinishedCallback callback)
 Time
 LoraPhy::GetTSym (LoraTxParameters txParams)
 {
-  return Seconds (pow (2, int (txParams.sf)) / (txParams.bandwidthHz));
+  return Seconds (std::ldexp (1.0, txParams.sf) / txParams.bandwidthHz);
 }
 
 Time
 LoraPhy::GetOnAirTime (Ptr<Packet> packet, LoraTxParameters txParams)
 {
-
   NS_LOG_FUNCTION (packet << txParams);
 
+  return NanoSeconds (GetOnAirTimeNs (packet->GetSize (), txParams));
+}
+
+int64_t
+LoraPhy::GetOnAirTimeNs (uint32_t size, LoraTxParameters txParams)
+{
+  // Durations of all payload sizes, for each combination of parameters
+  static std::unordered_map<uint64_t, std::vector<int64_t> > onAirTimes;
+
+  // Pack the parameters in a key. Only the usual values of the bandwidth and
+  // of the number of preamble symbols fit in it: if they don't, or if the
+  // packet is larger than a LoRa payload can be, skip the table.
+  uint32_t bandwidthHz = uint32_t (txParams.bandwidthHz);
+  if (size > 255 || bandwidthHz != txParams.bandwidthHz || bandwidthHz >= (1 << 24)
+      || txParams.nPreamble >= (1 << 16))
+    {
+      return ComputeOnAirTimeNs (size, txParams);
+    }
+  uint64_t key = uint64_t (bandwidthHz) << 35 | uint64_t (txParams.nPreamble) << 19 |
+                 uint64_t (txParams.sf) << 11 | uint64_t (txParams.codingRate) << 3 |
+                 uint64_t (txParams.headerDisabled) << 2 | uint64_t (txParams.crcEnabled) << 1 |
+                 uint64_t (txParams.lowDataRateOptimizationEnabled);
+
+  std::vector<int64_t> &durations = onAirTimes[key];
+  if (durations.empty ())
+    {
+      NS_LOG_DEBUG ("Computing the on air times for " << txParams);
+
+      durations.resize (256);
+      for (uint32_t i = 0; i < durations.size (); i++)
+        {
+          durations[i] = ComputeOnAirTimeNs (i, txParams);
+        }
+    }
+
+  return durations[size];
+}
+
+int64_t
+LoraPhy::ComputeOnAirTimeNs (uint32_t size, LoraTxParameters txParams)
+{
   // The contents of this function are based on [1].
   // [1] SX1272 LoRa modem designer's guide.
 
   // Compute the symbol duration
   // Bandwidth is in Hz
-  double tSym = GetTSym(txParams).GetSeconds();
+  double tSym = GetTSym (txParams).GetSeconds ();
 
   // Compute the preamble duration
   double tPreamble = (double(txParams.nPreamble) + 4.25) * tSym;
 
   // Payload size
-  uint32_t pl = packet->GetSize ();      // Size in bytes
+  uint32_t pl = size;      // Size in bytes
   NS_LOG_DEBUG ("Packet of size " << pl << " bytes");
 
   // This step is needed since the formula deals with double values.
@@ -188,7 +231,7 @@ LoraPhy::GetOnAirTime (Ptr<Packet> packet, LoraTxParameters txParams)
   double crc = txParams.crcEnabled ? 1 : 0;
 
   // num and den refer to numerator and denominator of the time on air formula
-  double num = 8 * pl - 4 * txParams.sf + 28 + 16 * crc - 20 * h;
+  double num = 8 * double (pl) - 4 * txParams.sf + 28 + 16 * crc - 20 * h;
   double den = 4 * (txParams.sf - 2 * de);
   double payloadSymbNb = 8 + std::max (std::ceil (num / den) *
                                        (txParams.codingRate + 4), double(0));
@@ -203,7 +246,7 @@ LoraPhy::GetOnAirTime (Ptr<Packet> packet, LoraTxParameters txParams)
   NS_LOG_DEBUG ("Total time = " << tPreamble + tPayload);
 
   // Compute and return the total packet on-air time
-  return Seconds (tPreamble + tPayload);
+  return std::llround ((tPreamble + tPayload) * 1e9);
 }
 
 std::ostream &operator << (std::ostream &os, const LoraTxParameters &params)
@@ -115,25 +115,30 @@ public:
    * \param sf The Spreading Factor of the arriving packet.
    * \param duration The on air time of this packet.
    * \param frequencyMHz The frequency this packet is being transmitted on.
+   * \param event The event this transmission was registered as in the
+   * channel's LoraInterferenceHelper.
    */
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm,
                              uint8_t sf, Time duration,
-                             double frequencyMHz) = 0;
+                             double frequencyMHz,
+                             Ptr<LoraInterferenceHelper::Event> event) = 0;
 
   /**
    * Finish reception of a packet.
    *
    * This method is scheduled by StartReceive, based on the packet duration. By
-   * passing a LoraInterferenceHelper Event to this method, the class will be
-   * able to identify the packet that is being received among all those that
-   * were registered as interference by StartReceive.
+   * passing a LoraInterferenceHelper Event to this method, the channel will be
+   * able to identify the packet that is being received among all the
+   * transmissions that were registered on it.
    *
    * \param packet The received packet.
-   * \param event The event that is tied to this packet in the
+   * \param event The event that is tied to this packet in the channel's
    * LoraInterferenceHelper.
+   * \param rxPowerDbm The power of the packet at this PHY.
    */
   virtual void EndReceive (Ptr<Packet> packet,
-                           Ptr<LoraInterferenceHelper::Event> event) = 0;
+                           Ptr<LoraInterferenceHelper::Event> event,
+                           double rxPowerDbm) = 0;
 
   /**
    * Instruct the PHY to send a packet according to some parameters.
@@ -254,7 +259,32 @@ public:
    */
   static Time GetOnAirTime (Ptr<Packet> packet, LoraTxParameters txParams);
 
+  /**
+   * Get the time that a payload of a certain size will take to be transmitted,
+   * in nanoseconds.
+   *
+   * Durations are computed once for each combination of transmission
+   * parameters and for all payload sizes up to 255 bytes, and then looked up
+   * in a table. Larger payloads are computed at each call.
+   *
+   * \param size The size of the packet, in bytes.
+   * \param txParams The set of parameters that will be used for transmission.
+   * \return The time necessary to transmit the packet, in nanoseconds.
+   */
+  static int64_t GetOnAirTimeNs (uint32_t size, LoraTxParameters txParams);
+
 private:
+  /**
+   * Compute the time that a payload of a certain size will take to be
+   * transmitted, in nanoseconds, using the formula of the SX1272 LoRa modem
+   * designer's guide.
+   *
+   * \param size The size of the packet, in bytes.
+   * \param txParams The set of parameters that will be used for transmission.
+   * \return The time necessary to transmit the packet, in nanoseconds.
+   */
+  static int64_t ComputeOnAirTimeNs (uint32_t size, LoraTxParameters txParams);
+
   Ptr<MobilityModel> m_mobility;   //!< The mobility model associated to this PHY.
 
 protected:
@@ -264,9 +294,6 @@ protected:
 
   Ptr<LoraChannel> m_channel; //!< The channel this PHY transmits on.
 
-  LoraInterferenceHelper m_interference; //!< The LoraInterferenceHelper
-  //!associated to this PHY.
-
   // Trace sources
 
   /**
@@ -159,5 +159,16 @@ LorawanMacHeader::IsConfirmed (void) const
   return (m_mtype == CONFIRMED_DATA_DOWN)
          || (m_mtype == CONFIRMED_DATA_UP);
 }
+
+LorawanMacHeader
+LorawanMacHeader::Peek (Ptr<const Packet> packet)
+{
+  NS_LOG_FUNCTION (packet);
+
+  // PeekHeader deserializes from the packet's buffer in place
+  LorawanMacHeader mHdr;
+  packet->PeekHeader (mHdr);
+  return mHdr;
+}
 }
 }
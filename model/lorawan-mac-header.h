@@ -22,6 +22,7 @@
 #define LORAWAN_MAC_HEADER_H
 
 #include "ns3/header.h"
+#include "ns3/packet.h"
 
 namespace ns3 {
 namespace lorawan {
@@ -121,6 +122,17 @@ public:
 
   bool IsConfirmed (void) const;
 
+  /**
+   * Read the header at the start of a packet.
+   *
+   * The packet is neither copied nor modified, so this is the cheapest way
+   * to find out the type of a packet.
+   *
+   * \param packet The packet, starting with a LorawanMacHeader.
+   * \return The header of the packet.
+   */
+  static LorawanMacHeader Peek (Ptr<const Packet> packet);
+
 private:
   /**
    * The Message Type.
@@ -22,13 +22,15 @@ NetworkScheduler::GetTypeId (void)
 }
 
 NetworkScheduler::NetworkScheduler ()
+  : m_nextSequence (0)
 {
 }
 
 NetworkScheduler::NetworkScheduler (Ptr<NetworkStatus> status,
                                     Ptr<NetworkController> controller) :
   m_status (status),
-  m_controller (controller)
+  m_controller (controller),
+  m_nextSequence (0)
 {
 }
 
@@ -37,31 +39,16 @@ NetworkScheduler::~NetworkScheduler ()
 }
 
 void
-NetworkScheduler::OnReceivedPacket (Ptr<const Packet> packet)
+NetworkScheduler::OnReceivedPacket (Ptr<const DecodedUplink> uplink)
 {
-  NS_LOG_FUNCTION (packet);
-
-  // Get the current packet's frame counter
-  Ptr<Packet> packetCopy = packet->Copy ();
-  LorawanMacHeader receivedMacHdr;
-  packetCopy->RemoveHeader (receivedMacHdr);
-  LoraFrameHeader receivedFrameHdr;
-  receivedFrameHdr.SetAsUplink ();
-  packetCopy->RemoveHeader (receivedFrameHdr);
+  NS_LOG_FUNCTION (uplink->GetPacket ());
 
   // Need to decide whether to schedule a receive window
-  if (!m_status->GetEndDeviceStatus (packet)->HasReceiveWindowOpportunityScheduled ())
+  Ptr<EndDeviceStatus> edStatus = m_status->GetEndDeviceStatus (uplink);
+  if (!edStatus->HasReceiveWindowOpportunityScheduled ())
   {
-    // Extract the address
-    LoraDeviceAddress deviceAddress = receivedFrameHdr.GetAddress ();
-
-    // Schedule OnReceiveWindowOpportunity event
-    m_status->GetEndDeviceStatus (packet)->SetReceiveWindowOpportunity (
-      Simulator::Schedule (Seconds (1),
-                           &NetworkScheduler::OnReceiveWindowOpportunity,
-                           this,
-                           deviceAddress,
-                           1)); // This will be the first receive window
+    // Queue the opportunity
+    QueueOpportunity (edStatus, 1); // This will be the first receive window
   }
 }
 
@@ -70,12 +57,108 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
 {
   NS_LOG_FUNCTION (deviceAddress);
 
+  // The status is a stable handle, so we only need to look it up once
+  OnReceiveWindowOpportunity (m_status->GetEndDeviceStatus (deviceAddress), window);
+}
+
+void
+NetworkScheduler::QueueOpportunity (Ptr<EndDeviceStatus> edStatus, int window)
+{
+  NS_LOG_FUNCTION (edStatus << window);
+
+  // Both opportunities come one second after the previous event: since the
+  // delay of each window is fixed, its queue stays sorted by time
+  Opportunity opportunity;
+  opportunity.time = Simulator::Now () + Seconds (1);
+  opportunity.sequence = m_nextSequence++;
+  opportunity.edStatus = edStatus;
+  opportunity.ticket = edStatus->QueueReceiveWindowOpportunity ();
+  m_opportunities[window - 1].push_back (opportunity);
+
+  ScheduleNextOpportunity ();
+}
+
+void
+NetworkScheduler::ScheduleNextOpportunity (void)
+{
+  if (m_opportunityEvent.IsRunning ())
+    {
+      // Opportunities are only added after the ones that are already queued
+      return;
+    }
+
+  Time next = Time::Max ();
+  for (int i = 0; i < 2; i++)
+    {
+      if (!m_opportunities[i].empty ())
+        {
+          next = std::min (next, m_opportunities[i].front ().time);
+        }
+    }
+
+  if (next != Time::Max ())
+    {
+      m_opportunityEvent = Simulator::Schedule (next - Simulator::Now (),
+                                                &NetworkScheduler::FireOpportunities,
+                                                this);
+    }
+}
+
+void
+NetworkScheduler::FireOpportunities (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  // Take the whole batch of due opportunities first, in the order they were
+  // queued, since handling them can queue opportunities for the second window
+  m_batch.clear ();
+  Time now = Simulator::Now ();
+  while (true)
+    {
+      int window = 0;
+      for (int i = 0; i < 2; i++)
+        {
+          if (!m_opportunities[i].empty () && m_opportunities[i].front ().time <= now
+              && (window == 0 || m_opportunities[i].front ().sequence
+                  < m_opportunities[window - 1].front ().sequence))
+            {
+              window = i + 1;
+            }
+        }
+      if (window == 0)
+        {
+          break;
+        }
+      m_batch.push_back (std::make_pair (m_opportunities[window - 1].front (), window));
+      m_opportunities[window - 1].pop_front ();
+    }
+
+  NS_LOG_DEBUG ("Handling " << m_batch.size () << " receive window opportunities");
+
+  for (auto it = m_batch.begin (); it != m_batch.end (); it++)
+    {
+      // Skip the opportunities that were removed in the meantime
+      if (it->first.edStatus->FireReceiveWindowOpportunity (it->first.ticket))
+        {
+          OnReceiveWindowOpportunity (it->first.edStatus, it->second);
+        }
+    }
+  m_batch.clear ();
+
+  ScheduleNextOpportunity ();
+}
+
+void
+NetworkScheduler::OnReceiveWindowOpportunity (Ptr<EndDeviceStatus> edStatus, int window)
+{
+  LoraDeviceAddress deviceAddress = edStatus->m_endDeviceAddress;
+
   NS_LOG_DEBUG ("Opening receive window number " << window << " for device "
                                                  << deviceAddress);
 
   // Check whether we can send a reply to the device, again by using
   // NetworkStatus
-  Address gwAddress = m_status->GetBestGatewayForDevice (deviceAddress, window);
+  Address gwAddress = m_status->GetBestGatewayForDevice (edStatus, window);
 
   if (gwAddress == Address () && window == 1)
     {
@@ -83,13 +166,8 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
 
       // No suitable GW was found, but there's still hope to find one for the
       // second window.
-      // Schedule another OnReceiveWindowOpportunity event
-      m_status->GetEndDeviceStatus (deviceAddress)->SetReceiveWindowOpportunity (
-        Simulator::Schedule (Seconds (1),
-                             &NetworkScheduler::OnReceiveWindowOpportunity,
-                             this,
-                             deviceAddress,
-                             2));     // This will be the second receive window
+      // Queue another opportunity
+      QueueOpportunity (edStatus, 2);     // This will be the second receive window
     }
   else if (gwAddress == Address () && window == 2)
     {
@@ -100,8 +178,8 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
 
       // Reset the reply
       // XXX Should we reset it here or keep it for the next opportunity?
-      m_status->GetEndDeviceStatus (deviceAddress)->RemoveReceiveWindowOpportunity();
-      m_status->GetEndDeviceStatus (deviceAddress)->InitializeReply ();
+      edStatus->RemoveReceiveWindowOpportunity();
+      edStatus->InitializeReply ();
     }
   else
     {
@@ -109,11 +187,10 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
 
       NS_LOG_DEBUG ("Found available gateway with address: " << gwAddress);
 
-      m_controller->BeforeSendingReply (m_status->GetEndDeviceStatus
-                                          (deviceAddress));
+      m_controller->BeforeSendingReply (edStatus);
 
-      // Check whether this device needs a response by querying m_status
-      bool needsReply = m_status->NeedsReply (deviceAddress);
+      // Check whether this device needs a response
+      bool needsReply = edStatus->NeedsReply ();
 
       if (needsReply)
         {
@@ -121,12 +198,12 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
 
           // Send the reply through that gateway
           m_status->SendThroughGateway (m_status->GetReplyForDevice
-                                          (deviceAddress, window),
+                                          (edStatus, window),
                                         gwAddress);
 
           // Reset the reply
-          m_status->GetEndDeviceStatus (deviceAddress)->RemoveReceiveWindowOpportunity();
-          m_status->GetEndDeviceStatus (deviceAddress)->InitializeReply ();
+          edStatus->RemoveReceiveWindowOpportunity();
+          edStatus->InitializeReply ();
         }
     }
 }
@@ -27,15 +27,30 @@
 #include "ns3/lora-device-address.h"
 #include "ns3/lorawan-mac-header.h"
 #include "ns3/lora-frame-header.h"
+#include "ns3/decoded-uplink.h"
 #include "ns3/network-controller.h"
 #include "ns3/network-status.h"
 
+#include <deque>
+#include <vector>
+
 namespace ns3 {
 namespace lorawan {
 
 class NetworkStatus;     // Forward declaration
 class NetworkController;     // Forward declaration
 
+/**
+ * Schedule the receive window opportunities of the devices that sent a
+ * packet to the Network Server.
+ *
+ * Opportunities happen a fixed delay after the uplink, or after the first
+ * opportunity for the second receive window, so each receive window keeps
+ * its pending opportunities in a queue that is already sorted by time. A
+ * single simulator event is pending at any time, for the earliest
+ * opportunity: when it fires, all the opportunities that are due are handled
+ * as a batch, and the event is scheduled again for the next one.
+ */
 class NetworkScheduler : public Object
 {
 public:
@@ -48,21 +63,59 @@ public:
 
   /**
    * Method called by NetworkServer to inform the Scheduler of a newly arrived
-   * uplink packet. This function schedules the OnReceiveWindowOpportunity
-   * events 1 and 2 seconds later.
+   * uplink packet. This function queues the receive window opportunities
+   * 1 and 2 seconds later.
    */
-  void OnReceivedPacket (Ptr<const Packet> packet);
+  void OnReceivedPacket (Ptr<const DecodedUplink> uplink);
 
   /**
-   * Method that is scheduled after packet arrivals in order to act on
+   * Method that is called after packet arrivals in order to act on
    * receive windows 1 and 2 seconds later receptions.
    */
   void OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, int window);
 
 private:
+  /**
+   * A receive window opportunity that is waiting in a queue.
+   */
+  struct Opportunity
+  {
+    Time time;                      //!< When the opportunity happens
+    uint64_t sequence;              //!< The order in which it was queued
+    Ptr<EndDeviceStatus> edStatus;  //!< The device
+    uint32_t ticket;                //!< The ticket given by the device status
+  };
+
+  /**
+   * Act on a receive window opportunity of a device.
+   */
+  void OnReceiveWindowOpportunity (Ptr<EndDeviceStatus> edStatus, int window);
+
+  /**
+   * Queue a receive window opportunity of a device, one receive delay from
+   * now.
+   */
+  void QueueOpportunity (Ptr<EndDeviceStatus> edStatus, int window);
+
+  /**
+   * Handle all the opportunities that are due, and wait for the next one.
+   */
+  void FireOpportunities (void);
+
+  /**
+   * Make sure the simulator event is scheduled for the earliest queued
+   * opportunity.
+   */
+  void ScheduleNextOpportunity (void);
+
   TracedCallback<Ptr<const Packet> > m_receiveWindowOpened;
   Ptr<NetworkStatus> m_status;
   Ptr<NetworkController> m_controller;
+
+  std::deque<Opportunity> m_opportunities[2];  //!< Pending opportunities of each window
+  std::vector<std::pair<Opportunity, int> > m_batch;  //!< Opportunities being handled
+  uint64_t m_nextSequence;  //!< The sequence number of the next opportunity
+  EventId m_opportunityEvent;  //!< The event of the earliest opportunity
 };
 
 } /* namespace ns3 */
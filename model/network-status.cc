@@ -29,6 +29,9 @@
 #include "ns3/node-container.h"
 #include "ns3/log.h"
 #include "ns3/pointer.h"
+#include "ns3/simulator.h"
+
+#include <algorithm>
 
 namespace ns3 {
 namespace lorawan {
@@ -90,6 +93,11 @@ NetworkStatus::AddGateway (Address& address, Ptr<GatewayStatus> gwStatus)
       // Add it to the map
       m_gatewayStatuses.insert (std::pair<Address, Ptr<GatewayStatus> >
                                 (address, gwStatus));
+
+      // Number the gateway, and make room for it in the bitmap
+      gwStatus->SetIndex (m_gateways.size ());
+      m_gateways.push_back (gwStatus);
+      m_busyGateways.resize ((m_gateways.size () + 63) / 64, 0);
       NS_LOG_DEBUG ("Added to the list a gateway with address " << address);
     }
 }
@@ -100,20 +108,23 @@ NetworkStatus::OnReceivedPacket (Ptr<const Packet> packet,
 {
   NS_LOG_FUNCTION (this << packet << gwAddress);
 
-  // Create a copy of the packet
-  Ptr<Packet> myPacket = packet->Copy ();
+  Ptr<const DecodedUplink> uplink = Create<DecodedUplink> (packet);
+  OnReceivedPacket (uplink, gwAddress);
+}
 
-  // Extract the headers
-  LorawanMacHeader macHdr;
-  myPacket->RemoveHeader (macHdr);
-  LoraFrameHeader frameHdr;
-  frameHdr.SetAsUplink ();
-  myPacket->RemoveHeader (frameHdr);
+void
+NetworkStatus::OnReceivedPacket (Ptr<const DecodedUplink> uplink,
+                                 const Address& gwAddress)
+{
+  NS_LOG_FUNCTION (this << uplink->GetPacket () << gwAddress);
 
   // Update the correct EndDeviceStatus object
-  LoraDeviceAddress edAddr = frameHdr.GetAddress ();
+  LoraDeviceAddress edAddr = uplink->GetAddress ();
   NS_LOG_DEBUG ("Node address: " << edAddr);
-  m_endDeviceStatuses.at (edAddr)->InsertReceivedPacket (packet, gwAddress);
+  auto gw = m_gatewayStatuses.find (gwAddress);
+  uint32_t gwIndex = gw != m_gatewayStatuses.end () ?
+    gw->second->GetIndex () : EndDeviceStatus::UNKNOWN_GATEWAY;
+  m_endDeviceStatuses.at (edAddr)->InsertReceivedPacket (uplink, gwAddress, gwIndex);
 }
 
 bool
@@ -127,7 +138,12 @@ Address
 NetworkStatus::GetBestGatewayForDevice (LoraDeviceAddress deviceAddress, int window)
 {
   // Get the endDeviceStatus we are interested in
-  Ptr<EndDeviceStatus> edStatus = m_endDeviceStatuses.at (deviceAddress);
+  return GetBestGatewayForDevice (m_endDeviceStatuses.at (deviceAddress), window);
+}
+
+Address
+NetworkStatus::GetBestGatewayForDevice (Ptr<EndDeviceStatus> edStatus, int window)
+{
   double replyFrequency;
   if (window == 1)
     {
@@ -145,19 +161,36 @@ NetworkStatus::GetBestGatewayForDevice (LoraDeviceAddress deviceAddress, int win
   // Get the list of gateways that this device can reach
   // NOTE: At this point, we could also take into account the whole network to
   // identify the best gateway according to various metrics. For now, we just
-  // ask the EndDeviceStatus to pick the best gateway for us via its method.
-  std::map<double, Address> gwAddresses = edStatus->GetPowerGatewayMap ();
+  // use the ranking the EndDeviceStatus keeps of the gateways that received
+  // its last packet, which goes from the 'best' gateway, i.e. the one with the
+  // highest received power, to the worst.
+  const EndDeviceStatus::GatewayRanking &ranking = edStatus->GetGatewayRanking ();
 
-  // By iterating on the map in reverse, we go from the 'best'
-  // gateway, i.e. the one with the highest received power, to the
-  // worst.
   Address bestGwAddress;
-  for (auto it = gwAddresses.rbegin(); it != gwAddresses.rend(); it++)
+  for (auto it = ranking.begin (); it != ranking.end (); it++)
     {
-      bool isAvailable = m_gatewayStatuses.find(it->second)->second->IsAvailableForTransmission (replyFrequency);
+      Ptr<GatewayStatus> gwStatus;
+      if (it->gwIndex < m_gateways.size ())
+        {
+          // Skip the gateways that were booked at this instant without
+          // querying them. Gateways that are transmitting are not marked,
+          // since their transmission can end at this same instant.
+          if (IsGatewayBusy (it->gwIndex))
+            {
+              continue;
+            }
+          gwStatus = m_gateways[it->gwIndex];
+        }
+      else
+        {
+          // The reception was not inserted through this object
+          gwStatus = m_gatewayStatuses.at (it->gwAddress);
+        }
+
+      bool isAvailable = gwStatus->IsAvailableForTransmission (replyFrequency);
       if (isAvailable)
         {
-          bestGwAddress = it->second;
+          bestGwAddress = it->gwAddress;
           break;
         }
     }
@@ -170,16 +203,25 @@ NetworkStatus::SendThroughGateway (Ptr<Packet> packet, Address gwAddress)
 {
   NS_LOG_FUNCTION (packet << gwAddress);
 
-  m_gatewayStatuses.find (gwAddress)->second->GetNetDevice ()->Send (packet,
-                                                                      gwAddress,
-                                                                      0x0800);
+  Ptr<GatewayStatus> gwStatus = m_gatewayStatuses.at (gwAddress);
+
+  // Book the gateway: the packet still has to reach it
+  gwStatus->SetNextTransmissionTime (Simulator::Now ());
+  SetGatewayBusy (gwStatus->GetIndex ());
+
+  gwStatus->GetNetDevice ()->Send (packet, gwAddress, 0x0800);
 }
 
 Ptr<Packet>
 NetworkStatus::GetReplyForDevice (LoraDeviceAddress edAddress, int windowNumber)
+{
+  return GetReplyForDevice (m_endDeviceStatuses.at (edAddress), windowNumber);
+}
+
+Ptr<Packet>
+NetworkStatus::GetReplyForDevice (Ptr<EndDeviceStatus> edStatus, int windowNumber)
 {
   // Get the reply packet
-  Ptr<EndDeviceStatus> edStatus = m_endDeviceStatuses.find (edAddress)->second;
   Ptr<Packet> packet = edStatus->GetCompleteReplyPacket ();
 
   // Apply the appropriate tag
@@ -205,22 +247,15 @@ NetworkStatus::GetEndDeviceStatus (Ptr<Packet const> packet)
 {
   NS_LOG_FUNCTION (this << packet);
 
-  // Get the address
-  LorawanMacHeader mHdr;
-  LoraFrameHeader fHdr;
-  Ptr<Packet> myPacket = packet->Copy ();
-  myPacket->RemoveHeader (mHdr);
-  myPacket->RemoveHeader (fHdr);
-  auto it = m_endDeviceStatuses.find (fHdr.GetAddress ());
-  if (it != m_endDeviceStatuses.end ())
-    {
-      return (*it).second;
-    }
-  else
-    {
-      NS_LOG_ERROR ("EndDeviceStatus not found");
-      return 0;
-    }
+  return GetEndDeviceStatus (LoraFrameHeader::PeekAddress (packet));
+}
+
+Ptr<EndDeviceStatus>
+NetworkStatus::GetEndDeviceStatus (Ptr<const DecodedUplink> uplink)
+{
+  NS_LOG_FUNCTION (this << uplink->GetPacket ());
+
+  return GetEndDeviceStatus (uplink->GetAddress ());
 }
 
 Ptr<EndDeviceStatus>
@@ -247,5 +282,60 @@ NetworkStatus::CountEndDevices (void)
 
   return m_endDeviceStatuses.size ();
 }
+
+Ptr<GatewayStatus>
+NetworkStatus::GetGatewayStatus (const Address &address)
+{
+  NS_LOG_FUNCTION (this << address);
+
+  auto it = m_gatewayStatuses.find (address);
+  if (it != m_gatewayStatuses.end ())
+    {
+      return (*it).second;
+    }
+  else
+    {
+      NS_LOG_ERROR ("GatewayStatus not found");
+      return 0;
+    }
+}
+
+void
+NetworkStatus::SetGatewayBusy (uint32_t index)
+{
+  if (m_busyGatewaysTime != Simulator::Now ())
+    {
+      std::fill (m_busyGateways.begin (), m_busyGateways.end (), 0);
+      m_busyGatewaysTime = Simulator::Now ();
+    }
+  m_busyGateways[index / 64] |= uint64_t (1) << (index % 64);
+}
+
+bool
+NetworkStatus::IsGatewayBusy (uint32_t index)
+{
+  if (m_busyGatewaysTime != Simulator::Now ())
+    {
+      // The bitmap refers to an earlier time
+      return false;
+    }
+  return (m_busyGateways[index / 64] >> (index % 64)) & 1;
+}
+
+size_t
+NetworkStatus::AddressHash::operator() (const Address &address) const
+{
+  // FNV-1a over the serialized address, which includes its type and length
+  uint8_t buffer[Address::MAX_SIZE + 2];
+  uint32_t size = address.CopyAllTo (buffer, sizeof (buffer));
+
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint32_t i = 0; i < size; ++i)
+    {
+      hash ^= buffer[i];
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+}
 }
 }
@@ -29,15 +29,31 @@
 #include "ns3/network-scheduler.h"
 
 #include <iterator>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
 
 /**
  * This class represents the knowledge about the state of the network that is
- * available at the Network Server. It is essentially a collection of two maps:
- * one containing DeviceStatus objects, and the other containing GatewayStatus
- * objects.
+ * available at the Network Server. It is essentially a collection of two hash
+ * maps: one containing DeviceStatus objects, keyed by LoraDeviceAddress, and
+ * the other containing GatewayStatus objects, keyed by the gateway's Address.
+ * Lookups take constant time regardless of how many devices are registered.
+ *
+ * Gateways are also numbered in the order they are added, so that the
+ * gateways that were booked through SendThroughGateway can be marked in a
+ * bitmap: when picking the gateway for a reply, gateways that were booked at
+ * the same instant are skipped without querying them. Since a booking lasts
+ * longer than an instant, this gives the same result as querying them, while
+ * whether a gateway is transmitting, which can change within an instant, is
+ * always checked on its MAC layer.
+ *
+ * The EndDeviceStatus and GatewayStatus objects are never replaced once they
+ * are added, so the pointers returned by GetEndDeviceStatus and
+ * GetGatewayStatus are stable handles that components can keep instead of
+ * repeating the lookup.
  *
  * This class is meant to be queried by NetworkController components, which
  * can decide to take action based on the current status of the network.
@@ -70,6 +86,15 @@ public:
    */
   void OnReceivedPacket (Ptr<const Packet> packet, const Address &gwaddress);
 
+  /**
+   * Update network status on the received packet, whose headers were already
+   * decoded.
+   *
+   * \param uplink the received packet.
+   * \param address the gateway this packet was received from.
+   */
+  void OnReceivedPacket (Ptr<const DecodedUplink> uplink, const Address &gwaddress);
+
   /**
    * Return whether the specified device needs a reply.
    *
@@ -85,12 +110,21 @@ public:
    */
   Address GetBestGatewayForDevice (LoraDeviceAddress deviceAddress, int window);
 
+  /**
+   * Return whether we have a gateway that is available to send a reply to the
+   * device with the specified status.
+   *
+   * \param edStatus the status of the device we are interested in.
+   */
+  Address GetBestGatewayForDevice (Ptr<EndDeviceStatus> edStatus, int window);
+
   /**
    * Send a packet through a Gateway.
    *
    * This function assumes that the packet is already tagged with a LoraTag
    * that will inform the gateway of the parameters to use for the
-   * transmission.
+   * transmission. The gateway is booked for the transmission, so that it's
+   * not picked for other replies before it starts transmitting.
    */
   void SendThroughGateway (Ptr<Packet> packet, Address gwAddress);
 
@@ -99,11 +133,23 @@ public:
    */
   Ptr<Packet> GetReplyForDevice (LoraDeviceAddress edAddress, int windowNumber);
 
+  /**
+   * Get the reply for the device with the specified status.
+   */
+  Ptr<Packet> GetReplyForDevice (Ptr<EndDeviceStatus> edStatus, int windowNumber);
+
   /**
    * Get the EndDeviceStatus for the device that sent a packet.
+   *
+   * The device address is read in place, without copying the packet.
    */
   Ptr<EndDeviceStatus> GetEndDeviceStatus (Ptr<Packet const> packet);
 
+  /**
+   * Get the EndDeviceStatus for the device that sent a decoded packet.
+   */
+  Ptr<EndDeviceStatus> GetEndDeviceStatus (Ptr<const DecodedUplink> uplink);
+
   /**
    * Get the EndDeviceStatus corresponding to a LoraDeviceAddress.
    */
@@ -114,9 +160,57 @@ public:
    */
   int CountEndDevices (void);
 
+  /**
+   * Get the GatewayStatus corresponding to an Address.
+   */
+  Ptr<GatewayStatus> GetGatewayStatus (const Address &address);
+
+  /**
+   * Hash an Address through its type and contents.
+   */
+  struct AddressHash
+  {
+    size_t operator() (const Address &address) const;
+  };
+
 public:
-  std::map<LoraDeviceAddress, Ptr<EndDeviceStatus>> m_endDeviceStatuses;
-  std::map<Address, Ptr<GatewayStatus>> m_gatewayStatuses;
+  /**
+   * The status of each device, keyed by its address.
+   *
+   * \remark Iterating on this map doesn't visit devices in address order,
+   * as it did when it was a std::map: code that relies on that order should
+   * sort the addresses first.
+   */
+  std::unordered_map<LoraDeviceAddress, Ptr<EndDeviceStatus> > m_endDeviceStatuses;
+
+  /**
+   * The status of each gateway, keyed by its address.
+   *
+   * \remark Iterating on this map doesn't visit gateways in address order,
+   * as it did when it was a std::map: code that relies on that order should
+   * sort the addresses first.
+   */
+  std::unordered_map<Address, Ptr<GatewayStatus>, AddressHash> m_gatewayStatuses;
+
+private:
+  /**
+   * Mark a gateway as busy in the busy gateways bitmap.
+   */
+  void SetGatewayBusy (uint32_t index);
+
+  /**
+   * Return whether a gateway is marked as busy in the busy gateways bitmap.
+   */
+  bool IsGatewayBusy (uint32_t index);
+
+  std::vector<Ptr<GatewayStatus> > m_gateways;   //!< The gateways, by index
+
+  /**
+   * The gateways that were booked at m_busyGatewaysTime, one bit per
+   * gateway index. The bitmap is cleared when the simulation time advances.
+   */
+  std::vector<uint64_t> m_busyGateways;
+  Time m_busyGatewaysTime;   //!< The time the busy gateways bitmap refers to
 };
 
 } // namespace lorawan
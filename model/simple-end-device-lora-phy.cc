@@ -112,29 +112,22 @@ SimpleEndDeviceLoraPhy::Send (Ptr<Packet> packet, LoraTxParameters txParams,
 
 void
 SimpleEndDeviceLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                                      uint8_t sf, Time duration, double frequencyMHz)
+                                      uint8_t sf, Time duration, double frequencyMHz,
+                                      Ptr<LoraInterferenceHelper::Event> event)
 {
 
   NS_LOG_FUNCTION (this << packet << rxPowerDbm << unsigned (sf) << duration <<
                    frequencyMHz);
 
-  // Notify the LoraInterferenceHelper of the impinging signal, and remember
-  // the event it creates. This will be used then to correctly handle the end
-  // of reception event.
-  //
-  // We need to do this regardless of our state or frequency, since these could
-  // change (and making the interference relevant) while the interference is
-  // still incoming.
-
-  Ptr<LoraInterferenceHelper::Event> event;
-  event = m_interference.Add (duration, rxPowerDbm, sf, packet, frequencyMHz);
+  // The impinging signal was already registered as interference by the
+  // channel, which gave us the corresponding event. This will be used then to
+  // correctly handle the end of reception event.
 
   // Switch on the current PHY state
   switch (m_state)
     {
-    // In the SLEEP, TX and RX cases we cannot receive the packet: we only add
-    // it to the list of interferers and do not schedule an EndReceive event for
-    // it.
+    // In the SLEEP, TX and RX cases we cannot receive the packet: it only acts
+    // as interference and we do not schedule an EndReceive event for it.
     case SLEEP:
       {
         NS_LOG_INFO ("Dropping packet because device is in SLEEP state");
@@ -241,7 +234,7 @@ SimpleEndDeviceLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
                          duration.GetSeconds () << " seconds");
 
             Simulator::Schedule (duration, &LoraPhy::EndReceive, this, packet,
-                                 event);
+                                 event, rxPowerDbm);
 
             // Fire the beginning of reception trace source
             m_phyRxBeginTrace (packet);
@@ -252,9 +245,10 @@ SimpleEndDeviceLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
 
 void
 SimpleEndDeviceLoraPhy::EndReceive (Ptr<Packet> packet,
-                                    Ptr<LoraInterferenceHelper::Event> event)
+                                    Ptr<LoraInterferenceHelper::Event> event,
+                                    double rxPowerDbm)
 {
-  NS_LOG_FUNCTION (this << packet << event);
+  NS_LOG_FUNCTION (this << packet << event << rxPowerDbm);
 
   // Automatically switch to Standby in either case
   SwitchToStandby ();
@@ -262,9 +256,9 @@ SimpleEndDeviceLoraPhy::EndReceive (Ptr<Packet> packet,
   // Fire the trace source
   m_phyRxEndTrace (packet);
 
-  // Call the LoraInterferenceHelper to determine whether there was destructive
-  // interference on this event.
-  bool packetDestroyed = m_interference.IsDestroyedByInterference (event);
+  // Ask the channel to determine whether there was destructive interference
+  // on this event at our position.
+  bool packetDestroyed = m_channel->IsDestroyedByInterference (event, rxPowerDbm, this);
 
   // Fire the trace source if packet was destroyed
   if (packetDestroyed)
@@ -49,11 +49,13 @@ public:
 
   // Implementation of EndDeviceLoraPhy's pure virtual functions
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                             uint8_t sf, Time duration, double frequencyMHz);
+                             uint8_t sf, Time duration, double frequencyMHz,
+                             Ptr<LoraInterferenceHelper::Event> event);
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void EndReceive (Ptr<Packet> packet,
-                           Ptr<LoraInterferenceHelper::Event> event);
+                           Ptr<LoraInterferenceHelper::Event> event,
+                           double rxPowerDbm);
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void Send (Ptr<Packet> packet, LoraTxParameters txParams,
@@ -66,15 +66,17 @@ SimpleGatewayLoraPhy::Send (Ptr<Packet> packet, LoraTxParameters txParams, doubl
 
   NS_LOG_DEBUG ("Duration of packet: " << duration << ", SF" << unsigned (txParams.sf));
 
-  // Interrupt all receive operations
-  std::list<Ptr<SimpleGatewayLoraPhy::ReceptionPath>>::iterator it;
-  for (it = m_receptionPaths.begin (); it != m_receptionPaths.end (); ++it)
+  // Interrupt all receive operations, visiting only the occupied reception
+  // paths
+  for (uint32_t w = 0; w < m_occupiedPaths.size (); w++)
     {
-
-      Ptr<SimpleGatewayLoraPhy::ReceptionPath> currentPath = *it;
-
-      if (!currentPath->IsAvailable ()) // Reception path is occupied
+      uint64_t occupied = m_occupiedPaths[w];
+      while (occupied != 0)
         {
+          Ptr<SimpleGatewayLoraPhy::ReceptionPath> currentPath =
+              m_receptionPaths[64 * w + __builtin_ctzll (occupied)];
+          occupied &= occupied - 1;
+
           // Call the callback for reception interrupted by transmission
           // Fire the trace source
           if (m_device)
@@ -92,7 +94,7 @@ SimpleGatewayLoraPhy::Send (Ptr<Packet> packet, LoraTxParameters txParams, doubl
 
           // Free it
           // This also resets all parameters like packet and endReceive call
-          currentPath->Free ();
+          FreeReceptionPath (currentPath->GetEvent ());
         }
     }
 
@@ -116,7 +118,8 @@ SimpleGatewayLoraPhy::Send (Ptr<Packet> packet, LoraTxParameters txParams, doubl
 
 void
 SimpleGatewayLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm, uint8_t sf,
-                                    Time duration, double frequencyMHz)
+                                    Time duration, double frequencyMHz,
+                                    Ptr<LoraInterferenceHelper::Event> event)
 {
   NS_LOG_FUNCTION (this << packet << rxPowerDbm << duration << frequencyMHz);
 
@@ -144,62 +147,53 @@ SimpleGatewayLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm, uint8
       return;
     }
 
-  // Add the event to the LoraInterferenceHelper
-  Ptr<LoraInterferenceHelper::Event> event;
-  event = m_interference.Add (duration, rxPowerDbm, sf, packet, frequencyMHz);
+  // Look for a receive path that is available and listening on the channel of
+  // interest
+  int32_t pathIndex = GetFreeReceptionPath (frequencyMHz);
 
-  // Cycle over the receive paths to check availability to receive the packet
-  std::list<Ptr<SimpleGatewayLoraPhy::ReceptionPath>>::iterator it;
-
-  for (it = m_receptionPaths.begin (); it != m_receptionPaths.end (); ++it)
+  if (pathIndex >= 0)
     {
-      Ptr<SimpleGatewayLoraPhy::ReceptionPath> currentPath = *it;
+      // See whether the reception power is above or below the sensitivity
+      // for that spreading factor
+      double sensitivity = SimpleGatewayLoraPhy::sensitivity[unsigned (sf) - 7];
 
-      // If the receive path is available and listening on the channel of
-      // interest, we have a candidate
-      if (currentPath->IsAvailable ())
+      if (rxPowerDbm < sensitivity) // Packet arrived below sensitivity
         {
-          // See whether the reception power is above or below the sensitivity
-          // for that spreading factor
-          double sensitivity = SimpleGatewayLoraPhy::sensitivity[unsigned (sf) - 7];
+          NS_LOG_INFO ("Dropping packet reception of packet with sf = "
+                       << unsigned (sf) << " because under the sensitivity of " << sensitivity
+                       << " dBm");
 
-          if (rxPowerDbm < sensitivity) // Packet arrived below sensitivity
+          if (m_device)
             {
-              NS_LOG_INFO ("Dropping packet reception of packet with sf = "
-                           << unsigned (sf) << " because under the sensitivity of " << sensitivity
-                           << " dBm");
-
-              if (m_device)
-                {
-                  m_underSensitivity (packet, m_device->GetNode ()->GetId ());
-                }
-              else
-                {
-                  m_underSensitivity (packet, 0);
-                }
-
-              // Since the packet is below sensitivity, it makes no sense to
-              // search for another ReceivePath
-              return;
+              m_underSensitivity (packet, m_device->GetNode ()->GetId ());
             }
-          else // We have sufficient sensitivity to start receiving
+          else
             {
-              NS_LOG_INFO ("Scheduling reception of a packet, "
-                           << "occupying one demodulator");
+              m_underSensitivity (packet, 0);
+            }
 
-              // Block this resource
-              currentPath->LockOnEvent (event);
-              m_occupiedReceptionPaths++;
+          // Since the packet is below sensitivity, it makes no sense to
+          // search for another ReceivePath
+          return;
+        }
+      else // We have sufficient sensitivity to start receiving
+        {
+          NS_LOG_INFO ("Scheduling reception of a packet, "
+                       << "occupying one demodulator");
 
-              // Schedule the end of the reception of the packet
-              EventId endReceiveEventId =
-                  Simulator::Schedule (duration, &LoraPhy::EndReceive, this, packet, event);
+          // Block this resource
+          Ptr<SimpleGatewayLoraPhy::ReceptionPath> currentPath =
+              LockReceptionPath (pathIndex, event);
 
-              currentPath->SetEndReceive (endReceiveEventId);
+          // Schedule the end of the reception of the packet
+          EventId endReceiveEventId =
+              Simulator::Schedule (duration, &LoraPhy::EndReceive, this, packet, event,
+                                   rxPowerDbm);
 
-              // Make sure we don't go on searching for other ReceivePaths
-              return;
-            }
+          currentPath->SetEndReceive (endReceiveEventId);
+
+          // Make sure we don't go on searching for other ReceivePaths
+          return;
         }
     }
   // If we get to this point, there are no demodulators we can use
@@ -219,18 +213,19 @@ SimpleGatewayLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm, uint8
 }
 
 void
-SimpleGatewayLoraPhy::EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event)
+SimpleGatewayLoraPhy::EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event,
+                                  double rxPowerDbm)
 {
-  NS_LOG_FUNCTION (this << packet << *event);
+  NS_LOG_FUNCTION (this << packet << *event << rxPowerDbm);
 
   // Call the trace source
   m_phyRxEndTrace (packet);
 
-  // Call the LoraInterferenceHelper to determine whether there was
-  // destructive interference. If the packet is correctly received, this
-  // method returns a 0.
+  // Ask the channel to determine whether there was destructive interference
+  // at our position. If the packet is correctly received, this method
+  // returns a 0.
   uint8_t packetDestroyed = 0;
-  packetDestroyed = m_interference.IsDestroyedByInterference (event);
+  packetDestroyed = m_channel->IsDestroyedByInterference (event, rxPowerDbm, this);
 
   // Check whether the packet was destroyed
   if (packetDestroyed != uint8_t (0))
@@ -279,7 +274,7 @@ SimpleGatewayLoraPhy::EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper
           // quality.
           LoraTag tag;
           packet->RemovePacketTag (tag);
-          tag.SetReceivePower (event->GetRxPowerdBm ());
+          tag.SetReceivePower (rxPowerDbm);
           tag.SetFrequency (event->GetFrequency ());
           packet->AddPacketTag (tag);
 
@@ -287,21 +282,8 @@ SimpleGatewayLoraPhy::EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper
         }
     }
 
-  // Search for the demodulator that was locked on this event to free it.
-
-  std::list<Ptr<SimpleGatewayLoraPhy::ReceptionPath>>::iterator it;
-
-  for (it = m_receptionPaths.begin (); it != m_receptionPaths.end (); ++it)
-    {
-      Ptr<SimpleGatewayLoraPhy::ReceptionPath> currentPath = *it;
-
-      if (currentPath->GetEvent () == event)
-        {
-          currentPath->Free ();
-          m_occupiedReceptionPaths--;
-          return;
-        }
-    }
+  // Free the demodulator that was locked on this event
+  FreeReceptionPath (event);
 }
 
 } // namespace lorawan
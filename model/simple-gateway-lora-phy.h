@@ -47,10 +47,12 @@ public:
   virtual ~SimpleGatewayLoraPhy ();
 
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm, uint8_t sf,
-                             Time duration, double frequencyMHz);
+                             Time duration, double frequencyMHz,
+                             Ptr<LoraInterferenceHelper::Event> event);
 
   virtual void EndReceive (Ptr<Packet> packet,
-                           Ptr<LoraInterferenceHelper::Event> event);
+                           Ptr<LoraInterferenceHelper::Event> event,
+                           double rxPowerDbm);
 
   virtual void Send (Ptr<Packet> packet, LoraTxParameters txParams,
                      double frequencyMHz, double txPowerDbm);
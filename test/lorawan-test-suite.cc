@@ -8,6 +8,15 @@
 #include "ns3/mobility-helper.h"
 #include "ns3/one-shot-sender-helper.h"
 #include "ns3/constant-position-mobility-model.h"
+#include "ns3/boolean.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/lora-packet-tracker.h"
+#include "ns3/correlated-shadowing-propagation-loss-model.h"
+#include "ns3/uinteger.h"
+#include "ns3/building-penetration-loss.h"
+#include "ns3/building.h"
+#include "ns3/mobility-building-info.h"
+#include <cmath>
 
 // An essential include is test.h
 #include "ns3/test.h"
@@ -84,6 +93,15 @@ InterferenceTest::DoRun (void)
   NS_TEST_EXPECT_MSG_EQ (retval, true, "Overlap computation didn't give the expected result");
   interferenceHelper.ClearAllEvents ();
 
+  // Events carry their power in W and their duration in time steps
+  event = interferenceHelper.Add (Seconds (2), 30, 7, 0, frequency);
+  NS_TEST_EXPECT_MSG_EQ_TOL (event->GetPowerW (), 1, 1e-9,
+                             "Event power was not converted to W correctly");
+  NS_TEST_EXPECT_MSG_EQ (event->GetEndTick () - event->GetStartTick (),
+                         Seconds (2).GetTimeStep (),
+                         "Event duration in time steps is not the expected one");
+  interferenceHelper.ClearAllEvents ();
+
   // Perfect overlap, packet survives
   event = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency);
   interferenceHelper.Add (Seconds (2), 14, 12, 0, frequency);
@@ -164,6 +182,71 @@ InterferenceTest::DoRun (void)
   NS_TEST_EXPECT_MSG_EQ (interferenceHelper.IsDestroyedByInterference (event), 0,
                          "Packet did not survive interference as expected");
   interferenceHelper.ClearAllEvents ();
+
+  // Events are stored on all frequencies
+  interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency);
+  interferenceHelper.Add (Seconds (2), 14, 7, 0, differentFrequency);
+  interferenceHelper.Add (Seconds (1), 14, 8, 0, frequency);
+  NS_TEST_EXPECT_MSG_EQ (interferenceHelper.GetInterferers ().size (), 3,
+                         "Not all events were stored");
+  interferenceHelper.ClearAllEvents ();
+  NS_TEST_EXPECT_MSG_EQ (interferenceHelper.GetInterferers ().size (), 0,
+                         "Events were not cleared");
+
+  // Shared events use the power that was set for each receiver
+  Ptr<ConstantPositionMobilityModel> sender = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> receiver = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> otherReceiver =
+      CreateObject<ConstantPositionMobilityModel> ();
+  double rxPowerW;
+
+  event = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, sender);
+  event->SetRxPowerW (otherReceiver, 2e-3);
+  event->SetRxPowerW (receiver, 1e-3);
+  NS_TEST_EXPECT_MSG_EQ (event->GetRxPowerW (receiver, rxPowerW), true,
+                         "Shared event has no power at the receiver");
+  NS_TEST_EXPECT_MSG_EQ_TOL (rxPowerW, 1e-3, 1e-12, "Shared event has the wrong power");
+  NS_TEST_EXPECT_MSG_EQ (event->GetRxPowerW (sender, rxPowerW), false,
+                         "Shared event has a power at a device it was not set for");
+
+  // An interferer 5 dB below the packet at the receiver destroys it, while
+  // the same interferer 7 dB below does not.
+  event1 = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, otherReceiver);
+  event1->SetRxPowerW (receiver, 1e-3 * std::pow (10, -5.0 / 10));
+  NS_TEST_EXPECT_MSG_EQ (interferenceHelper.IsDestroyedByInterference (event, 0, receiver), 7,
+                         "Shared interferer did not destroy the packet");
+  interferenceHelper.ClearAllEvents ();
+
+  event = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, sender);
+  event1 = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, otherReceiver);
+  event1->SetRxPowerW (receiver, 1e-3 * std::pow (10, -7.0 / 10));
+  NS_TEST_EXPECT_MSG_EQ (interferenceHelper.IsDestroyedByInterference (event, 0, receiver), 0,
+                         "Shared interferer destroyed the packet");
+  interferenceHelper.ClearAllEvents ();
+
+  // A shared interferer with no power at the receiver is not interference
+  event = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, sender);
+  event1 = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, otherReceiver);
+  NS_TEST_EXPECT_MSG_EQ (interferenceHelper.IsDestroyedByInterference (event, 0, receiver), 0,
+                         "Shared interferer without a power at the receiver destroyed the packet");
+  interferenceHelper.ClearAllEvents ();
+
+  // The receiver's own transmissions are not interference, even if they
+  // were given a power at the receiver
+  event = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, sender);
+  event1 = interferenceHelper.Add (Seconds (2), 14, 7, 0, frequency, receiver);
+  event1->SetRxPowerW (receiver, 1);
+  NS_TEST_EXPECT_MSG_EQ (interferenceHelper.IsDestroyedByInterference (event, 0, receiver), 0,
+                         "The receiver's own transmission destroyed the packet");
+  interferenceHelper.ClearAllEvents ();
+
+  // Only events that did not end yet are ongoing
+  interferenceHelper.Add (Seconds (0), 14, 7, 0, frequency, sender);
+  interferenceHelper.Add (Seconds (1), 14, 7, 0, differentFrequency, sender);
+  std::vector<Ptr<LoraInterferenceHelper::Event> > ongoing;
+  interferenceHelper.GetOngoingEvents (ongoing);
+  NS_TEST_EXPECT_MSG_EQ (ongoing.size (), 1, "Ended events were reported as ongoing");
+  interferenceHelper.ClearAllEvents ();
 }
 
 /***************
@@ -340,6 +423,14 @@ HeaderTest::DoRun (void)
   //        = 10 + (8+3) + 1 = 22
   NS_TEST_EXPECT_MSG_EQ ((pkt->GetSize ()), 22, "Wrong size of packet + headers");
 
+  // Peeking at the MAC header leaves the packet untouched
+  LorawanMacHeader peekedMacHdr = LorawanMacHeader::Peek (pkt);
+  NS_TEST_EXPECT_MSG_EQ (peekedMacHdr.GetMType (), macHdr.GetMType (),
+                         "Peeked header contents don't match");
+  NS_TEST_EXPECT_MSG_EQ (peekedMacHdr.IsUplink (), false,
+                         "Peeked header direction doesn't match");
+  NS_TEST_EXPECT_MSG_EQ ((pkt->GetSize ()), 22, "Peeking changed the size of the packet");
+
   LorawanMacHeader macHdr1;
 
   pkt->RemoveHeader (macHdr1);
@@ -487,6 +578,42 @@ ReceivePathTest::DoRun (void)
 
   Reset ();
 
+  ////////////////////////////////////////////////////////////////////////
+  // Reception paths dedicated to a frequency only receive packets on it //
+  ////////////////////////////////////////////////////////////////////////
+
+  gatewayPhy = CreateObject<SimpleGatewayLoraPhy> ();
+  gatewayPhy->TraceConnectWithoutContext (
+      "LostPacketBecauseNoMoreReceivers",
+      MakeCallback (&ReceivePathTest::NoMoreDemodulators, this));
+  gatewayPhy->TraceConnectWithoutContext (
+      "OccupiedReceptionPaths", MakeCallback (&ReceivePathTest::OccupiedReceptionPaths, this));
+
+  gatewayPhy->AddReceptionPath (868.1);
+  gatewayPhy->AddReceptionPath (868.3);
+  gatewayPhy->AddReceptionPath ();
+
+  // The first two packets on 868.1 take the dedicated path and the one that
+  // can receive on any frequency, the third one finds no free path, and the
+  // one on 868.3 takes its dedicated path.
+  LoraInterferenceHelper interferenceHelper;
+  double frequencies[4] = {868.1, 868.1, 868.1, 868.3};
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      Ptr<LoraInterferenceHelper::Event> event =
+          interferenceHelper.Add (Seconds (1), 14, 7, packet, frequencies[i]);
+      Simulator::Schedule (Seconds (1), &SimpleGatewayLoraPhy::StartReceive, gatewayPhy, packet,
+                           14.0, uint8_t (7), Seconds (1), frequencies[i], event);
+    }
+
+  // Stop before the end of the receptions, which would need a channel
+  Simulator::Stop (Seconds (1.5));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_noMoreDemodulatorsCalls, 1, "Unexpected value");
+  NS_TEST_EXPECT_MSG_EQ (m_maxOccupiedReceptionPaths, 3, "Unexpected value");
+
   // FIXME
   // //////////////////////////////////////////////////////////////////////////////////
   // // If no ReceptionPath is configured to listen on a frequency, no packet is received
@@ -847,6 +974,99 @@ LogicalLoraChannelTest::DoRun (void)
                          "Waiting time affects other subbands");
   NS_TEST_EXPECT_MSG_EQ (channelHelper->GetWaitingTime (channel5), Time (0),
                          "Waiting time affects other subbands");
+
+  // Only the channels in the other subband are available
+  std::vector<uint64_t> available;
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetAvailableChannels (available), 2,
+                         "Available channels don't behave as expected");
+  NS_TEST_EXPECT_MSG_EQ (available.size (), 1,
+                         "Available channels don't behave as expected");
+  NS_TEST_EXPECT_MSG_EQ (available[0], 0x18,
+                         "Available channels don't behave as expected");
+
+  // Frequencies can be used instead of channels
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetWaitingTime (868.3), expectedTimeOff,
+                         "Waiting time doesn't behave as expected");
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetWaitingTime (869.2), Time (0),
+                         "Waiting time affects other subbands");
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetTxPowerForFrequency (869.2), 27,
+                         "Maximum power doesn't behave as expected");
+
+  // Copies of a helper share the channels, but not their state
+  /////////////////////////////////////////////////////////////
+
+  LogicalLoraChannelHelper copy = *channelHelper;
+  copy.AddEvent (Seconds (2), channel4);
+  copy.DisableChannel (1);
+
+  NS_TEST_EXPECT_MSG_EQ (copy.GetWaitingTime (channel1), expectedTimeOff,
+                         "Copy doesn't keep the duty cycle state");
+  NS_TEST_EXPECT_MSG_EQ (copy.GetWaitingTime (channel4), Seconds (2 / 0.1 - 2),
+                         "Waiting time doesn't behave as expected");
+
+  // The shortest waiting time among the enabled channels is the one of the
+  // SubBand that is released first
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetMinWaitingTime (), Time (0),
+                         "Minimum waiting time doesn't behave as expected");
+  NS_TEST_EXPECT_MSG_EQ (copy.GetMinWaitingTime (), Seconds (2 / 0.1 - 2),
+                         "Minimum waiting time doesn't behave as expected");
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetWaitingTime (channel4), Time (0),
+                         "Transmission on a copy affects the original");
+  NS_TEST_EXPECT_MSG_EQ (copy.GetEnabledChannelList ().size (), 4,
+                         "Channel was not disabled");
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetEnabledChannelList ().size (), 5,
+                         "Disabling a channel on a copy affects the original");
+
+  copy.RemoveChannel (channel1);
+  NS_TEST_EXPECT_MSG_EQ (copy.GetChannelList ().size (), 4,
+                         "Channel was not removed");
+  NS_TEST_EXPECT_MSG_EQ (copy.IsChannelEnabled (0), false,
+                         "Channel states were not shifted after removal");
+  NS_TEST_EXPECT_MSG_EQ (channelHelper->GetChannelList ().size (), 5,
+                         "Removing a channel on a copy affects the original");
+
+  // Plans can have more than 64 channels
+  ///////////////////////////////////////
+
+  // 64 + 8 uplink channels, like in US915, in two SubBands
+  Ptr<LogicalLoraChannelHelper> largeHelper = CreateObject<LogicalLoraChannelHelper> ();
+  largeHelper->AddSubBand (902, 915, 0.01, 30);
+  largeHelper->AddSubBand (915, 928, 0.01, 30);
+  for (int i = 0; i < 64; i++)
+    {
+      largeHelper->AddChannel (902.3 + 0.2 * i);
+    }
+  for (int i = 0; i < 8; i++)
+    {
+      largeHelper->AddChannel (915.5 + 1.6 * i);
+    }
+
+  NS_TEST_EXPECT_MSG_EQ (largeHelper->GetAvailableChannels (available), 72,
+                         "Not all the channels are available");
+  NS_TEST_EXPECT_MSG_EQ (available.size (), 2,
+                         "Available channels don't behave as expected");
+
+  // Only the 8 channels in the second SubBand are available after a
+  // transmission in the first one
+  largeHelper->AddEvent (Seconds (1), largeHelper->GetChannel (0));
+  NS_TEST_EXPECT_MSG_EQ (largeHelper->GetAvailableChannels (available), 8,
+                         "Available channels don't behave as expected");
+  NS_TEST_EXPECT_MSG_EQ (available[0], 0,
+                         "Available channels don't behave as expected");
+  NS_TEST_EXPECT_MSG_EQ (available[1], 0xff,
+                         "Available channels don't behave as expected");
+
+  // Channel states are shifted across words when a channel is removed
+  largeHelper->DisableChannel (64);
+  NS_TEST_EXPECT_MSG_EQ (largeHelper->IsChannelEnabled (64), false,
+                         "Channel was not disabled");
+  largeHelper->RemoveChannel (largeHelper->GetChannel (0));
+  NS_TEST_EXPECT_MSG_EQ (largeHelper->GetEnabledChannelList ().size (), 70,
+                         "Channel was not removed");
+  NS_TEST_EXPECT_MSG_EQ (largeHelper->IsChannelEnabled (63), false,
+                         "Channel states were not shifted after removal");
+  NS_TEST_EXPECT_MSG_EQ (largeHelper->IsChannelEnabled (64), true,
+                         "Channel states were not shifted after removal");
 }
 
 /*****************
@@ -957,6 +1177,15 @@ TimeOnAirTest::DoRun (void)
   txParams.codingRate = 1;
   duration = LoraPhy::GetOnAirTime (packet, txParams);
   NS_TEST_EXPECT_MSG_EQ_TOL (duration.GetSeconds (), 2.301952, 0.0001, "Unexpected duration");
+
+  // The table gives the same durations in nanoseconds
+  NS_TEST_EXPECT_MSG_EQ (LoraPhy::GetOnAirTimeNs (50, txParams), 2301952000,
+                         "Unexpected duration in nanoseconds");
+
+  // Payloads that are too large for the table are still computed
+  packet = Create<Packet> (300);
+  duration = LoraPhy::GetOnAirTime (packet, txParams);
+  NS_TEST_EXPECT_MSG_EQ_TOL (duration.GetSeconds (), 10.493952, 0.0001, "Unexpected duration");
 }
 
 /**************************
@@ -975,6 +1204,7 @@ public:
   void NoMoreDemodulators (Ptr<const Packet> packet, uint32_t node);
   void WrongFrequency (Ptr<const Packet> packet, uint32_t node);
   void WrongSf (Ptr<const Packet> packet, uint32_t node);
+  void PacketSent (Ptr<const Packet> packet);
   bool HaveSamePacketContents (Ptr<Packet> packet1, Ptr<Packet> packet2);
 
 private:
@@ -991,6 +1221,7 @@ private:
   int m_noMoreDemodulatorsCalls = 0;
   int m_wrongSfCalls = 0;
   int m_wrongFrequencyCalls = 0;
+  int m_packetSentCalls = 0;
 };
 
 // Add some help text to this case to describe what it is intended to test
@@ -1054,6 +1285,14 @@ PhyConnectivityTest::WrongFrequency (Ptr<const Packet> packet, uint32_t node)
   m_wrongFrequencyCalls++;
 }
 
+void
+PhyConnectivityTest::PacketSent (Ptr<const Packet> packet)
+{
+  NS_LOG_FUNCTION (packet);
+
+  m_packetSentCalls++;
+}
+
 bool
 PhyConnectivityTest::HaveSamePacketContents (Ptr<Packet> packet1, Ptr<Packet> packet2)
 {
@@ -1089,6 +1328,7 @@ PhyConnectivityTest::Reset (void)
   m_interferenceCalls = 0;
   m_wrongSfCalls = 0;
   m_wrongFrequencyCalls = 0;
+  m_packetSentCalls = 0;
 
   Ptr<LogDistancePropagationLossModel> loss = CreateObject<LogDistancePropagationLossModel> ();
   loss->SetPathLossExponent (3.76);
@@ -1098,6 +1338,8 @@ PhyConnectivityTest::Reset (void)
 
   // Create the channel
   channel = CreateObject<LoraChannel> (loss, delay);
+  channel->TraceConnectWithoutContext ("PacketSent",
+                                       MakeCallback (&PhyConnectivityTest::PacketSent, this));
 
   // Connect PHYs
   edPhy1 = CreateObject<SimpleEndDeviceLoraPhy> ();
@@ -1223,6 +1465,9 @@ PhyConnectivityTest::DoRun (void)
       m_receivedPacketCalls, 2,
       "Channel skipped some PHYs when delivering a packet"); // All PHYs except the sender
 
+  NS_TEST_EXPECT_MSG_EQ (m_packetSentCalls, 1,
+                         "PacketSent was not fired once for the transmission");
+
   Reset ();
 
   // Sleeping PHYs do not receive the packet
@@ -1242,6 +1487,23 @@ PhyConnectivityTest::DoRun (void)
 
   Reset ();
 
+  // PHYs that wake up receive packets again
+
+  edPhy2->SwitchToSleep ();
+  edPhy2->SwitchToStandby ();
+
+  Simulator::Schedule (Seconds (2), &SimpleEndDeviceLoraPhy::Send, edPhy1, packet, txParams, 868.1,
+                       14);
+
+  Simulator::Stop (Hours (2));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_receivedPacketCalls, 2,
+                         "Packet was not received by a PHY that went back to STANDBY");
+
+  Reset ();
+
   // Packet that arrives under sensitivity is received correctly if SF increases
 
   txParams.sf = 7;
@@ -1358,6 +1620,56 @@ PhyConnectivityTest::DoRun (void)
                          "State didn't switch to STANDBY as expected");
   NS_TEST_EXPECT_MSG_EQ (edPhy2->GetState (), SimpleEndDeviceLoraPhy::STANDBY,
                          "State didn't switch to STANDBY as expected");
+
+  Reset ();
+
+  // Spatial culling
+  //////////////////
+
+  // Receivers that are out of range are not notified, until they get closer
+  channel->SetAttribute ("SpatialCulling", BooleanValue (true));
+  txParams.sf = 12;
+  edPhy2->GetMobility ()->SetPosition (Vector (100000, 0, 0));
+
+  Simulator::Schedule (Seconds (2), &SimpleEndDeviceLoraPhy::Send, edPhy1, packet, txParams, 868.1,
+                       14);
+  Simulator::Schedule (Seconds (5), &MobilityModel::SetPosition, edPhy2->GetMobility (),
+                       Vector (10, 0, 0));
+  Simulator::Schedule (Seconds (10), &SimpleEndDeviceLoraPhy::Send, edPhy1, packet, txParams,
+                       868.1, 14);
+
+  Simulator::Stop (Hours (2));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_underSensitivityCalls, 0,
+                         "A receiver out of range was notified of the packet");
+  NS_TEST_EXPECT_MSG_EQ (m_receivedPacketCalls, 3,
+                         "A receiver in range was not notified of the packet");
+
+  Reset ();
+
+  // Link budget cache
+  ////////////////////
+
+  // Cached link budgets are recomputed when a device moves
+  channel->SetAttribute ("CacheLinkBudget", BooleanValue (true));
+
+  Simulator::Schedule (Seconds (2), &SimpleEndDeviceLoraPhy::Send, edPhy1, packet, txParams, 868.1,
+                       14);
+  Simulator::Schedule (Seconds (5), &MobilityModel::SetPosition, edPhy2->GetMobility (),
+                       Vector (100000, 0, 0));
+  Simulator::Schedule (Seconds (10), &SimpleEndDeviceLoraPhy::Send, edPhy1, packet, txParams,
+                       868.1, 14);
+
+  Simulator::Stop (Hours (2));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_receivedPacketCalls, 3,
+                         "Packets were not received as expected with cached link budgets");
+  NS_TEST_EXPECT_MSG_EQ (m_underSensitivityCalls, 1,
+                         "A stale link budget was used after a device moved");
 }
 
 /*****************
@@ -1393,6 +1705,366 @@ LorawanMacTest::DoRun (void)
   NS_LOG_DEBUG ("LorawanMacTest");
 }
 
+/*********************
+ * PacketTrackerTest *
+ *********************/
+
+class PacketTrackerTest : public TestCase
+{
+public:
+  PacketTrackerTest ();
+  virtual ~PacketTrackerTest ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Schedule the transmissions and outcomes of a few uplink packets.
+   */
+  void ScheduleTraffic (LoraPacketTracker *tracker);
+
+  /**
+   * Create an uplink packet of a certain type.
+   */
+  Ptr<Packet> CreateUplink (LorawanMacHeader::MType mType);
+};
+
+// Add some help text to this case to describe what it is intended to test
+PacketTrackerTest::PacketTrackerTest ()
+    : TestCase ("Verify that LoraPacketTracker counts packets as expected")
+{
+}
+
+// Reminder that the test case should clean up after itself
+PacketTrackerTest::~PacketTrackerTest ()
+{
+}
+
+Ptr<Packet>
+PacketTrackerTest::CreateUplink (LorawanMacHeader::MType mType)
+{
+  Ptr<Packet> packet = Create<Packet> (10);
+  LorawanMacHeader macHdr;
+  macHdr.SetMType (mType);
+  packet->AddHeader (macHdr);
+  return packet;
+}
+
+void
+PacketTrackerTest::ScheduleTraffic (LoraPacketTracker *tracker)
+{
+  Ptr<Packet> confirmed = CreateUplink (LorawanMacHeader::CONFIRMED_DATA_UP);
+  Ptr<Packet> unconfirmed1 = CreateUplink (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+  Ptr<Packet> unconfirmed2 = CreateUplink (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+  Ptr<Packet> unconfirmed3 = CreateUplink (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+
+  // A confirmed packet is interfered at the gateway
+  Simulator::Schedule (Seconds (1), &LoraPacketTracker::MacTransmissionCallback, tracker,
+                       confirmed);
+  Simulator::Schedule (Seconds (1), &LoraPacketTracker::TransmissionCallback, tracker,
+                       confirmed, 0);
+  Simulator::Schedule (Seconds (1.5), &LoraPacketTracker::InterferenceCallback, tracker,
+                       confirmed, 1);
+
+  // An unconfirmed packet is received, and the tracker releases the packets
+  // that are older than the release delay
+  Simulator::Schedule (Seconds (15), &LoraPacketTracker::MacTransmissionCallback, tracker,
+                       unconfirmed1);
+  Simulator::Schedule (Seconds (15), &LoraPacketTracker::TransmissionCallback, tracker,
+                       unconfirmed1, 0);
+  Simulator::Schedule (Seconds (15.5), &LoraPacketTracker::PacketReceptionCallback, tracker,
+                       unconfirmed1, 1);
+  Simulator::Schedule (Seconds (15.5), &LoraPacketTracker::MacGwReceptionCallback, tracker,
+                       unconfirmed1);
+
+  // The confirmed packet is retransmitted well after the release delay, and
+  // is received
+  Simulator::Schedule (Seconds (30), &LoraPacketTracker::TransmissionCallback, tracker,
+                       confirmed, 0);
+  Simulator::Schedule (Seconds (30.5), &LoraPacketTracker::PacketReceptionCallback, tracker,
+                       confirmed, 1);
+  Simulator::Schedule (Seconds (30.5), &LoraPacketTracker::MacGwReceptionCallback, tracker,
+                       confirmed);
+  Simulator::Schedule (Seconds (31), &LoraPacketTracker::RequiredTransmissionsCallback, tracker,
+                       uint8_t (2), true, Seconds (1), confirmed);
+
+  // Outcomes of a packet that was already released are ignored
+  Simulator::Schedule (Seconds (32), &LoraPacketTracker::MacTransmissionCallback, tracker,
+                       unconfirmed2);
+  Simulator::Schedule (Seconds (32), &LoraPacketTracker::TransmissionCallback, tracker,
+                       unconfirmed2, 0);
+  Simulator::Schedule (Seconds (50), &LoraPacketTracker::MacTransmissionCallback, tracker,
+                       unconfirmed3);
+  Simulator::Schedule (Seconds (50), &LoraPacketTracker::TransmissionCallback, tracker,
+                       unconfirmed3, 0);
+  Simulator::Schedule (Seconds (51), &LoraPacketTracker::UnderSensitivityCallback, tracker,
+                       unconfirmed2, 1);
+  Simulator::Schedule (Seconds (51), &LoraPacketTracker::MacGwReceptionCallback, tracker,
+                       unconfirmed2);
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+PacketTrackerTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("PacketTrackerTest");
+
+  // The same traffic is tracked with 10 s intervals and with the default
+  // ones, which must give the same counts
+  LoraPacketTracker tracker;
+  tracker.SetBucketWidth (Seconds (10));
+  LoraPacketTracker defaultTracker;
+
+  ScheduleTraffic (&tracker);
+  ScheduleTraffic (&defaultTracker);
+
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  LoraPacketTracker *trackers[] = {&tracker, &defaultTracker};
+  for (LoraPacketTracker *t : trackers)
+    {
+      // Each transmission is a separate PHY packet: sent, received,
+      // interfered, no more receivers, under sensitivity, lost because TX
+      std::vector<int> counts = t->CountPhyPacketsPerGw (Seconds (0), Seconds (60), 1);
+      std::vector<int> expected = {5, 2, 1, 0, 0, 0};
+      NS_TEST_EXPECT_MSG_EQ ((counts == expected), true,
+                             "Unexpected PHY counts: " << t->PrintPhyPacketsPerGw
+                               (Seconds (0), Seconds (60), 1));
+
+      // Time frames that cover whole intervals, and ones that start and stop
+      // in the middle of an interval
+      counts = t->CountPhyPacketsPerGw (Seconds (0), Seconds (9), 1);
+      expected = {1, 0, 1, 0, 0, 0};
+      NS_TEST_EXPECT_MSG_EQ ((counts == expected), true,
+                             "Unexpected PHY counts in the first interval");
+      counts = t->CountPhyPacketsPerGw (Seconds (30), Seconds (39), 1);
+      expected = {2, 1, 0, 0, 0, 0};
+      NS_TEST_EXPECT_MSG_EQ ((counts == expected), true,
+                             "Unexpected PHY counts in the fourth interval");
+      counts = t->CountPhyPacketsPerGw (Seconds (5), Seconds (35), 1);
+      expected = {3, 2, 0, 0, 0, 0};
+      NS_TEST_EXPECT_MSG_EQ ((counts == expected), true,
+                             "Unexpected PHY counts across intervals");
+
+      // The retransmission of the confirmed packet counts for the MAC packet
+      // sent at its first attempt
+      NS_TEST_EXPECT_MSG_EQ (t->CountMacPacketsGlobally (Seconds (0), Seconds (60)),
+                             std::to_string (4.0) + " " + std::to_string (2.0),
+                             "Unexpected MAC counts");
+      NS_TEST_EXPECT_MSG_EQ (t->CountMacPacketsGlobally (Seconds (0), Seconds (9)),
+                             std::to_string (1.0) + " " + std::to_string (1.0),
+                             "Confirmed retransmission was not counted");
+      NS_TEST_EXPECT_MSG_EQ (t->CountMacPacketsGlobally (Seconds (5), Seconds (45)),
+                             std::to_string (2.0) + " " + std::to_string (1.0),
+                             "Unexpected MAC counts across intervals");
+      NS_TEST_EXPECT_MSG_EQ (t->CountMacPacketsGloballyCpsr (Seconds (0), Seconds (60)),
+                             std::to_string (1.0) + " " + std::to_string (1.0),
+                             "Unexpected retransmission counts");
+    }
+}
+
+/*****************
+ * ShadowingTest *
+ *****************/
+
+class ShadowingTest : public TestCase
+{
+public:
+  ShadowingTest ();
+  virtual ~ShadowingTest ();
+
+private:
+  virtual void DoRun (void);
+};
+
+// Add some help text to this case to describe what it is intended to test
+ShadowingTest::ShadowingTest ()
+    : TestCase ("Verify that the correlated shadowing model yields consistent values")
+{
+}
+
+// Reminder that the test case should clean up after itself
+ShadowingTest::~ShadowingTest ()
+{
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+ShadowingTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("ShadowingTest");
+
+  Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel> ();
+  a->SetPosition (Vector (0, 0, 0));
+
+  //////////////////////////////////////////////////
+  // Vertices are shared between adjacent squares //
+  //////////////////////////////////////////////////
+
+  // With a correlation distance of 100 m, the vertex at (50, 50) is shared by
+  // squares (0, 0), (1, 0), (0, 1) and (1, 1). Since the interpolation yields
+  // the value of the vertex at the vertex itself, points very close to it
+  // should see about the same shadowing, whichever square they fall in.
+  Ptr<CorrelatedShadowingPropagationLossModel> shadowing =
+    CreateObject<CorrelatedShadowingPropagationLossModel> ();
+  shadowing->SetCorrelationDistance (100);
+
+  b->SetPosition (Vector (50, 50, 0));
+  double vertexPower = shadowing->CalcRxPower (14, a, b);
+  double oldPower = vertexPower;
+  NS_LOG_DEBUG ("Power at the vertex: " << vertexPower);
+
+  double offsets[3][2] = {{-0.01, -0.01}, {0.01, -0.01}, {-0.01, 0.01}};
+  for (int i = 0; i < 3; i++)
+    {
+      b->SetPosition (Vector (50 + offsets[i][0], 50 + offsets[i][1], 0));
+      double power = shadowing->CalcRxPower (14, a, b);
+      NS_LOG_DEBUG ("Power close to the vertex: " << power);
+      NS_TEST_EXPECT_MSG_EQ_TOL (power, vertexPower, 0.05,
+                                 "Adjacent squares don't share the vertex value");
+    }
+
+  ////////////////////////////////////////
+  // Repeated queries are deterministic //
+  ////////////////////////////////////////
+
+  std::vector<double> powers;
+  for (int i = 0; i < 10; i++)
+    {
+      b->SetPosition (Vector (37 * i - 150, 23 * i - 100, 0));
+      powers.push_back (shadowing->CalcRxPower (14, a, b));
+    }
+  for (int i = 0; i < 10; i++)
+    {
+      b->SetPosition (Vector (37 * i - 150, 23 * i - 100, 0));
+      NS_TEST_EXPECT_MSG_EQ (shadowing->CalcRxPower (14, a, b), powers[i],
+                             "Repeated query yielded a different value");
+    }
+
+  //////////////////////////////////////////////////
+  // Evicted positions are recomputed identically //
+  //////////////////////////////////////////////////
+
+  Ptr<CorrelatedShadowingPropagationLossModel> limited =
+    CreateObject<CorrelatedShadowingPropagationLossModel> ();
+  limited->SetAttribute ("MaxCachedPositions", UintegerValue (2));
+
+  // Fill the cache of a's map with more positions than it can hold, so that
+  // the first ones are evicted
+  powers.clear ();
+  for (int i = 0; i < 5; i++)
+    {
+      b->SetPosition (Vector (20 * i, 10 * i, 0));
+      powers.push_back (limited->CalcRxPower (14, a, b));
+    }
+  for (int i = 0; i < 5; i++)
+    {
+      b->SetPosition (Vector (20 * i, 10 * i, 0));
+      NS_TEST_EXPECT_MSG_EQ (limited->CalcRxPower (14, a, b), powers[i],
+                             "Evicted position yielded a different value");
+    }
+
+  /////////////////////////////////////////////////////////
+  // Changing the correlation distance discards old maps //
+  /////////////////////////////////////////////////////////
+
+  // With the new distance, (50, 50) is the center of square (1, 1) instead
+  // of being a vertex, so its value must be generated again
+  shadowing->SetCorrelationDistance (50);
+  NS_TEST_EXPECT_MSG_EQ (shadowing->GetCorrelationDistance (), 50,
+                         "Correlation distance was not changed");
+
+  b->SetPosition (Vector (50, 50, 0));
+  NS_TEST_EXPECT_MSG_NE (shadowing->CalcRxPower (14, a, b), oldPower,
+                         "Value computed with the old distance was used");
+
+  // (25, 25) is now a vertex
+  b->SetPosition (Vector (25, 25, 0));
+  vertexPower = shadowing->CalcRxPower (14, a, b);
+  b->SetPosition (Vector (25.01, 24.99, 0));
+  NS_TEST_EXPECT_MSG_EQ_TOL (shadowing->CalcRxPower (14, a, b), vertexPower, 0.05,
+                             "Adjacent squares don't share the vertex value "
+                             "after changing the correlation distance");
+}
+
+/*******************************
+ * BuildingPenetrationLossTest *
+ *******************************/
+
+class BuildingPenetrationLossTest : public TestCase
+{
+public:
+  BuildingPenetrationLossTest ();
+  virtual ~BuildingPenetrationLossTest ();
+
+private:
+  virtual void DoRun (void);
+};
+
+// Add some help text to this case to describe what it is intended to test
+BuildingPenetrationLossTest::BuildingPenetrationLossTest ()
+    : TestCase ("Verify that the building penetration loss is only fixed if requested")
+{
+}
+
+// Reminder that the test case should clean up after itself
+BuildingPenetrationLossTest::~BuildingPenetrationLossTest ()
+{
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+BuildingPenetrationLossTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("BuildingPenetrationLossTest");
+
+  Ptr<Building> building = CreateObject<Building> ();
+  building->SetBoundaries (Box (0, 10, 0, 10, 0, 6));
+
+  // The transmitter is outdoors, the receiver is inside the building
+  Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel> ();
+  a->SetPosition (Vector (100, 100, 1.5));
+  b->SetPosition (Vector (5, 5, 1.5));
+  a->AggregateObject (CreateObject<MobilityBuildingInfo> ());
+  b->AggregateObject (CreateObject<MobilityBuildingInfo> ());
+
+  //////////////////////////////////////////////
+  // By default, the loss is drawn every time //
+  //////////////////////////////////////////////
+
+  Ptr<BuildingPenetrationLoss> loss = CreateObject<BuildingPenetrationLoss> ();
+
+  double first = loss->CalcRxPower (14, a, b);
+  bool changed = false;
+  for (int i = 0; i < 10; i++)
+    {
+      changed = changed || loss->CalcRxPower (14, a, b) != first;
+    }
+  NS_TEST_EXPECT_MSG_EQ (changed, true,
+                         "Loss of the link was fixed without FixedLinkLoss");
+
+  //////////////////////////////////////////////////////
+  // With FixedLinkLoss, the loss of a link is reused //
+  //////////////////////////////////////////////////////
+
+  loss = CreateObject<BuildingPenetrationLoss> ();
+  loss->SetAttribute ("FixedLinkLoss", BooleanValue (true));
+
+  first = loss->CalcRxPower (14, a, b);
+  NS_TEST_EXPECT_MSG_LT (first, 14, "Indoor receiver experienced no loss");
+  for (int i = 0; i < 10; i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (loss->CalcRxPower (14, a, b), first,
+                             "Loss of the link changed with FixedLinkLoss");
+    }
+}
+
 /**************
  * Test Suite *
  **************/
@@ -1418,6 +2090,9 @@ LorawanTestSuite::LorawanTestSuite () : TestSuite ("lorawan", UNIT)
   AddTestCase (new LogicalLoraChannelTest, TestCase::QUICK);
   AddTestCase (new TimeOnAirTest, TestCase::QUICK);
   AddTestCase (new PhyConnectivityTest, TestCase::QUICK);
+  AddTestCase (new PacketTrackerTest, TestCase::QUICK);
+  AddTestCase (new ShadowingTest, TestCase::QUICK);
+  AddTestCase (new BuildingPenetrationLossTest, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
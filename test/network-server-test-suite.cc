@@ -15,6 +15,7 @@
 #include "ns3/callback.h"
 #include "ns3/network-server.h"
 #include "ns3/network-server-helper.h"
+#include "ns3/decoded-uplink.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
@@ -267,6 +268,83 @@ LinkCheckTest::DoRun (void)
   NS_ASSERT (m_receivedPacketAtEd);
 }
 
+///////////////////////
+// DecodedUplinkTest //
+///////////////////////
+
+class DecodedUplinkTest : public TestCase
+{
+public:
+  DecodedUplinkTest ();
+  virtual ~DecodedUplinkTest ();
+
+private:
+  virtual void DoRun (void);
+};
+
+// Add some help text to this case to describe what it is intended to test
+DecodedUplinkTest::DecodedUplinkTest ()
+  : TestCase ("Verify that DecodedUplink reads the headers and the tag"
+              " of an uplink packet")
+{
+}
+
+// Reminder that the test case should clean up after itself
+DecodedUplinkTest::~DecodedUplinkTest ()
+{
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+DecodedUplinkTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("DecodedUplinkTest");
+
+  // Build an uplink packet like a gateway forwards it to the server
+  Ptr<Packet> packet = Create<Packet> (20);
+
+  LoraDeviceAddress address (54, 1864);
+  LoraFrameHeader frameHdr;
+  frameHdr.SetAsUplink ();
+  frameHdr.SetAddress (address);
+  frameHdr.SetFCnt (42);
+  frameHdr.SetAdr (true);
+  packet->AddHeader (frameHdr);
+
+  LorawanMacHeader macHdr;
+  macHdr.SetMType (LorawanMacHeader::CONFIRMED_DATA_UP);
+  packet->AddHeader (macHdr);
+
+  LoraTag tag;
+  tag.SetSpreadingFactor (9);
+  tag.SetReceivePower (-110);
+  tag.SetFrequency (868.3);
+  packet->AddPacketTag (tag);
+
+  uint32_t size = packet->GetSize ();
+
+  Ptr<DecodedUplink> uplink = Create<DecodedUplink> (packet);
+
+  NS_TEST_EXPECT_MSG_EQ (uplink->GetAddress (), address, "Wrong device address");
+  NS_TEST_EXPECT_MSG_EQ (uplink->GetFCnt (), 42, "Wrong frame counter");
+  NS_TEST_EXPECT_MSG_EQ (uplink->GetFrameHeader ().GetAdr (), true, "Wrong ADR bit");
+  NS_TEST_EXPECT_MSG_EQ (uplink->GetMacHeader ().GetMType (),
+                         LorawanMacHeader::CONFIRMED_DATA_UP, "Wrong message type");
+
+  LoraTag decodedTag = uplink->GetTag ();
+  NS_TEST_EXPECT_MSG_EQ (unsigned (decodedTag.GetSpreadingFactor ()), 9,
+                         "Wrong spreading factor in the tag");
+  NS_TEST_EXPECT_MSG_EQ_TOL (decodedTag.GetReceivePower (), -110, 1e-9,
+                             "Wrong receive power in the tag");
+  NS_TEST_EXPECT_MSG_EQ_TOL (decodedTag.GetFrequency (), 868.3, 1e-9,
+                             "Wrong frequency in the tag");
+
+  // The received packet is kept as it is
+  NS_TEST_EXPECT_MSG_EQ (uplink->GetPacket (), packet, "The packet was not kept");
+  NS_TEST_EXPECT_MSG_EQ (packet->GetSize (), size, "The packet was modified");
+}
+
 /**************
  * Test Suite *
  **************/
@@ -305,6 +383,7 @@ NetworkServerTestSuite::NetworkServerTestSuite ()
   AddTestCase (new UplinkPacketTest, TestCase::QUICK);
   AddTestCase (new DownlinkPacketTest, TestCase::QUICK);
   AddTestCase (new LinkCheckTest, TestCase::QUICK);
+  AddTestCase (new DecodedUplinkTest, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
@@ -12,6 +12,8 @@
 #include "ns3/log.h"
 #include "ns3/end-device-status.h"
 #include "ns3/network-status.h"
+#include "ns3/lora-tag.h"
+#include "ns3/uinteger.h"
 #include "utilities.h"
 
 // An essential include is test.h
@@ -56,6 +58,148 @@ EndDeviceStatusTest::DoRun (void)
 
   // Create an EndDeviceStatus object
   EndDeviceStatus eds = EndDeviceStatus ();
+
+  // Only keep the last 3 packets
+  Ptr<EndDeviceStatus> status = CreateObject<EndDeviceStatus> ();
+  status->SetAttribute ("MaxReceivedPackets", UintegerValue (3));
+
+  Address gw1 = Mac48Address ("00:00:00:00:00:01");
+  Address gw2 = Mac48Address ("00:00:00:00:00:02");
+
+  for (uint16_t fCnt = 0; fCnt < 5; fCnt++)
+    {
+      Ptr<Packet> packet = Create<Packet> (10);
+
+      LoraFrameHeader frameHdr;
+      frameHdr.SetAsUplink ();
+      frameHdr.SetFCnt (fCnt);
+      packet->AddHeader (frameHdr);
+
+      LorawanMacHeader macHdr;
+      macHdr.SetMType (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+      packet->AddHeader (macHdr);
+
+      LoraTag tag (7);
+      tag.SetFrequency (868.1);
+      tag.SetReceivePower (-100 - fCnt);
+      packet->AddPacketTag (tag);
+
+      // Each packet is received by both gateways
+      Ptr<const DecodedUplink> uplink = Create<DecodedUplink> (packet);
+      status->InsertReceivedPacket (uplink, gw1);
+      status->InsertReceivedPacket (uplink, gw2);
+    }
+
+  EndDeviceStatus::ReceivedPacketList list = status->GetReceivedPacketList ();
+  NS_TEST_EXPECT_MSG_EQ (list.size (), 3, "Old packets were not discarded");
+  NS_TEST_EXPECT_MSG_EQ (list.front ().second.fCnt, 2,
+                         "Packets were not discarded from the oldest");
+  NS_TEST_EXPECT_MSG_EQ (list.back ().second.fCnt, 4,
+                         "Last packet is not at the end of the list");
+  NS_TEST_EXPECT_MSG_EQ (list.back ().second.gwList.size (), 2,
+                         "Receptions of the same packet were not merged");
+  NS_TEST_EXPECT_MSG_EQ ((list.front ().second.packet == 0), true,
+                         "Old packets are still referenced");
+  NS_TEST_EXPECT_MSG_EQ (status->GetLastUplinkReceivedFromDevice ()->GetFCnt (), 4,
+                         "Last packet is not kept");
+
+  // The history can be read without copies, and the reception powers at the
+  // gateways are already combined
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketCount (), 3,
+                         "Old packets were not discarded");
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketInfo (2).fCnt, 2,
+                         "Packets are not ordered by age");
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketInfo (0).rxPowerSum, -208,
+                         "Reception powers were not combined");
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketInfo (0).maxRxPower, -104,
+                         "Reception powers were not combined");
+
+  // Both gateways received the last packet with the same power, and both are
+  // ranked, in the order they received it
+  const EndDeviceStatus::GatewayRanking &ranking = status->GetGatewayRanking ();
+  NS_TEST_ASSERT_MSG_EQ (ranking.size (), 2, "Gateways with the same power collided");
+  NS_TEST_EXPECT_MSG_EQ (ranking[0].gwAddress, gw1, "Wrong gateway ranking");
+  NS_TEST_EXPECT_MSG_EQ (ranking[1].gwAddress, gw2, "Wrong gateway ranking");
+
+  // A better gateway that receives the last packet goes first, while late
+  // receptions of older packets don't change the ranking
+  Address gw3 = Mac48Address ("00:00:00:00:00:03");
+  Ptr<Packet> packet = Create<Packet> (10);
+  LoraFrameHeader frameHdr;
+  frameHdr.SetAsUplink ();
+  frameHdr.SetFCnt (3);
+  packet->AddHeader (frameHdr);
+  LorawanMacHeader macHdr;
+  macHdr.SetMType (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+  packet->AddHeader (macHdr);
+  LoraTag tag (7);
+  tag.SetFrequency (868.1);
+  tag.SetReceivePower (-90);
+  packet->AddPacketTag (tag);
+  Ptr<const DecodedUplink> oldUplink = Create<DecodedUplink> (packet);
+  status->InsertReceivedPacket (oldUplink, gw3);
+  NS_TEST_EXPECT_MSG_EQ (ranking.size (), 2, "Old packet changed the ranking");
+
+  frameHdr.SetFCnt (4);
+  packet = Create<Packet> (10);
+  packet->AddHeader (frameHdr);
+  packet->AddHeader (macHdr);
+  packet->AddPacketTag (tag);
+  Ptr<const DecodedUplink> lastUplink = Create<DecodedUplink> (packet);
+  status->InsertReceivedPacket (lastUplink, gw3);
+  NS_TEST_ASSERT_MSG_EQ (ranking.size (), 3, "Gateway was not ranked");
+  NS_TEST_EXPECT_MSG_EQ (ranking[0].gwAddress, gw3, "Wrong gateway ranking");
+  NS_TEST_EXPECT_MSG_EQ (ranking[2].gwAddress, gw2, "Wrong gateway ranking");
+
+  // Queued receive window opportunities only fire if they were not removed
+  // or replaced
+  uint32_t ticket = status->QueueReceiveWindowOpportunity ();
+  NS_TEST_EXPECT_MSG_EQ (status->HasReceiveWindowOpportunityScheduled (), true,
+                         "Opportunity was not queued");
+  status->RemoveReceiveWindowOpportunity ();
+  NS_TEST_EXPECT_MSG_EQ (status->FireReceiveWindowOpportunity (ticket), false,
+                         "Removed opportunity fired");
+  ticket = status->QueueReceiveWindowOpportunity ();
+  uint32_t newTicket = status->QueueReceiveWindowOpportunity ();
+  NS_TEST_EXPECT_MSG_EQ (status->FireReceiveWindowOpportunity (ticket), false,
+                         "Replaced opportunity fired");
+  NS_TEST_EXPECT_MSG_EQ (status->FireReceiveWindowOpportunity (newTicket), true,
+                         "Opportunity did not fire");
+  NS_TEST_EXPECT_MSG_EQ (status->HasReceiveWindowOpportunityScheduled (), false,
+                         "Fired opportunity is still scheduled");
+
+  // Raising MaxReceivedPackets after the history wrapped around keeps the
+  // packets in order
+  status->SetAttribute ("MaxReceivedPackets", UintegerValue (5));
+  frameHdr.SetFCnt (5);
+  packet = Create<Packet> (10);
+  packet->AddHeader (frameHdr);
+  packet->AddHeader (macHdr);
+  packet->AddPacketTag (tag);
+  status->InsertReceivedPacket (Create<DecodedUplink> (packet), gw1);
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketCount (), 4,
+                         "History did not grow");
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketInfo (0).fCnt, 5,
+                         "Last packet is not the newest one");
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketInfo (3).fCnt, 2,
+                         "Packets are not ordered by age");
+  list = status->GetReceivedPacketList ();
+  NS_TEST_EXPECT_MSG_EQ (list.front ().second.fCnt, 2,
+                         "Packets are not ordered by age");
+  NS_TEST_EXPECT_MSG_EQ (list.back ().second.fCnt, 5,
+                         "Last packet is not at the end of the list");
+
+  // Late receptions still find their packet
+  frameHdr.SetFCnt (2);
+  packet = Create<Packet> (10);
+  packet->AddHeader (frameHdr);
+  packet->AddHeader (macHdr);
+  packet->AddPacketTag (tag);
+  status->InsertReceivedPacket (Create<DecodedUplink> (packet), gw3);
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketInfo (3).gwList.size (), 3,
+                         "Late reception was not merged with its packet");
+  NS_TEST_EXPECT_MSG_EQ (status->GetReceivedPacketCount (), 4,
+                         "Late reception was inserted as a new packet");
 }
 
 /////////////////////////////
@@ -101,7 +245,39 @@ NetworkStatusTest::DoRun (void)
   NodeContainer endDevices = components.endDevices;
   NodeContainer gateways = components.gateways;
 
-  ns.AddNode (GetMacLayerFromNode<ClassAEndDeviceLorawanMac> (endDevices.Get (0)));
+  Ptr<ClassAEndDeviceLorawanMac> edMac =
+    GetMacLayerFromNode<ClassAEndDeviceLorawanMac> (endDevices.Get (0));
+  ns.AddNode (edMac);
+
+  // Adding the same device again doesn't replace its status
+  LoraDeviceAddress address = edMac->GetDeviceAddress ();
+  Ptr<EndDeviceStatus> edStatus = ns.GetEndDeviceStatus (address);
+  NS_TEST_ASSERT_MSG_NE (edStatus, 0, "Device was not registered");
+  ns.AddNode (edMac);
+  NS_TEST_EXPECT_MSG_EQ (ns.CountEndDevices (), 1, "Device was registered twice");
+  NS_TEST_EXPECT_MSG_EQ (ns.GetEndDeviceStatus (address), edStatus,
+                         "Device status was replaced");
+
+  // The device is also found from the headers of one of its packets
+  Ptr<Packet> packet = Create<Packet> (10);
+  LoraFrameHeader frameHdr;
+  frameHdr.SetAsUplink ();
+  frameHdr.SetAddress (address);
+  packet->AddHeader (frameHdr);
+  LorawanMacHeader macHdr;
+  macHdr.SetMType (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+  packet->AddHeader (macHdr);
+  NS_TEST_EXPECT_MSG_EQ (LoraFrameHeader::PeekAddress (packet), address,
+                         "Wrong address read from the packet");
+  Ptr<const Packet> constPacket = packet;
+  NS_TEST_EXPECT_MSG_EQ (ns.GetEndDeviceStatus (constPacket), edStatus,
+                         "Device not found from its packet");
+
+  // Unknown devices and gateways are not found
+  NS_TEST_EXPECT_MSG_EQ (ns.GetEndDeviceStatus (LoraDeviceAddress (address.Get () + 1)),
+                         0, "Unknown device was found");
+  NS_TEST_EXPECT_MSG_EQ (ns.GetGatewayStatus (Mac48Address ("00:00:00:00:00:01")),
+                         0, "Unknown gateway was found");
 }
 
 /**************